@@ -78,6 +78,17 @@ int query_DXT_capability( void );
 #define SOIL_RGBA_S3TC_DXT1		0x83F1
 #define SOIL_RGBA_S3TC_DXT3		0x83F2
 #define SOIL_RGBA_S3TC_DXT5		0x83F3
+/*	for single and dual channel RGTC (BC4 / BC5) compression	*/
+static int has_RGTC_capability = SOIL_CAPABILITY_UNKNOWN;
+int query_RGTC_capability( void );
+#define SOIL_COMPRESSED_RED_RGTC1	0x8DBB
+#define SOIL_COMPRESSED_RG_RGTC2	0x8DBD
+/*	extension queries that also work in core profile contexts	*/
+#define SOIL_NUM_EXTENSIONS			0x821D
+typedef const GLubyte * (APIENTRY * P_SOIL_GLGETSTRINGIPROC) (GLenum name, GLuint index);
+int SOIL_extension_supported( const char *name );
+void *SOIL_get_proc_address( const char *name );
+int SOIL_load_compressed_upload( void );
 typedef void (APIENTRY * P_SOIL_GLCOMPRESSEDTEXIMAGE2DPROC) (GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const GLvoid * data);
 P_SOIL_GLCOMPRESSEDTEXIMAGE2DPROC soilGlCompressedTexImage2D = NULL;
 unsigned int SOIL_direct_load_DDS(
@@ -1498,6 +1509,16 @@ int
 		save_result = save_image_as_DDS( filename,
 				width, height, channels, (const unsigned char *const)data );
 	} else
+	if( image_type == SOIL_SAVE_TYPE_DDS_BC4 )
+	{
+		save_result = save_image_as_DDS_RGTC( filename,
+				width, height, channels, 1, (const unsigned char *const)data );
+	} else
+	if( image_type == SOIL_SAVE_TYPE_DDS_BC5 )
+	{
+		save_result = save_image_as_DDS_RGTC( filename,
+				width, height, channels, 2, (const unsigned char *const)data );
+	} else
 	{
 		save_result = 0;
 	}
@@ -1590,7 +1611,11 @@ unsigned int SOIL_direct_load_DDS_from_memory(
 		!(
 		(header.sPixelFormat.dwFourCC == (('D'<<0)|('X'<<8)|('T'<<16)|('1'<<24))) ||
 		(header.sPixelFormat.dwFourCC == (('D'<<0)|('X'<<8)|('T'<<16)|('3'<<24))) ||
-		(header.sPixelFormat.dwFourCC == (('D'<<0)|('X'<<8)|('T'<<16)|('5'<<24)))
+		(header.sPixelFormat.dwFourCC == (('D'<<0)|('X'<<8)|('T'<<16)|('5'<<24))) ||
+		(header.sPixelFormat.dwFourCC == (('A'<<0)|('T'<<8)|('I'<<16)|('1'<<24))) ||
+		(header.sPixelFormat.dwFourCC == (('A'<<0)|('T'<<8)|('I'<<16)|('2'<<24))) ||
+		(header.sPixelFormat.dwFourCC == (('B'<<0)|('C'<<8)|('4'<<16)|('U'<<24))) ||
+		(header.sPixelFormat.dwFourCC == (('B'<<0)|('C'<<8)|('5'<<16)|('U'<<24)))
 		) )
 	{
 		goto quick_exit;
@@ -1612,6 +1637,30 @@ unsigned int SOIL_direct_load_DDS_from_memory(
 		}
 		DDS_main_size = width * height * block_size;
 	} else
+	if( (header.sPixelFormat.dwFourCC == (('A'<<0)|('T'<<8)|('I'<<16)|('1'<<24))) ||
+		(header.sPixelFormat.dwFourCC == (('A'<<0)|('T'<<8)|('I'<<16)|('2'<<24))) ||
+		(header.sPixelFormat.dwFourCC == (('B'<<0)|('C'<<8)|('4'<<16)|('U'<<24))) ||
+		(header.sPixelFormat.dwFourCC == (('B'<<0)|('C'<<8)|('5'<<16)|('U'<<24))) )
+	{
+		/*	single / dual channel RGTC, checked before the DXT digit switch	*/
+		if( query_RGTC_capability() != SOIL_CAPABILITY_PRESENT )
+		{
+			/*	we can't do it!	*/
+			result_string_pointer = "Direct upload of RGTC images not supported by the OpenGL driver";
+			return 0;
+		}
+		if( (header.sPixelFormat.dwFourCC == (('A'<<0)|('T'<<8)|('I'<<16)|('1'<<24))) ||
+			(header.sPixelFormat.dwFourCC == (('B'<<0)|('C'<<8)|('4'<<16)|('U'<<24))) )
+		{
+			S3TC_type = SOIL_COMPRESSED_RED_RGTC1;
+			block_size = 8;
+		} else
+		{
+			S3TC_type = SOIL_COMPRESSED_RG_RGTC2;
+			block_size = 16;
+		}
+		DDS_main_size = ((width+3)>>2)*((height+3)>>2)*block_size;
+	} else
 	{
 		/*	can we even handle direct uploading to OpenGL DXT compressed images?	*/
 		if( query_DXT_capability() != SOIL_CAPABILITY_PRESENT )
@@ -1672,23 +1721,13 @@ unsigned int SOIL_direct_load_DDS_from_memory(
 	}
 	if( (header.sCaps.dwCaps1 & DDSCAPS_MIPMAP) && (header.dwMipMapCount > 1) )
 	{
-		int shift_offset;
 		mipmaps = header.dwMipMapCount - 1;
 		DDS_full_size = DDS_main_size;
-		if( uncompressed )
-		{
-			/*	uncompressed DDS, simple MIPmap size calculation	*/
-			shift_offset = 0;
-		} else
-		{
-			/*	compressed DDS, MIPmap size calculation is block based	*/
-			shift_offset = 2;
-		}
 		for( i = 1; i <= mipmaps; ++ i )
 		{
 			int w, h;
-			w = width >> (shift_offset + i);
-			h = height >> (shift_offset + i);
+			w = width >> i;
+			h = height >> i;
 			if( w < 1 )
 			{
 				w = 1;
@@ -1697,7 +1736,16 @@ unsigned int SOIL_direct_load_DDS_from_memory(
 			{
 				h = 1;
 			}
-			DDS_full_size += w*h*block_size;
+			if( uncompressed )
+			{
+				/*	uncompressed DDS, simple MIPmap size calculation	*/
+				DDS_full_size += w*h*block_size;
+			} else
+			{
+				/*	compressed DDS, MIPmap size calculation is block based
+					(the same partial blocks as the upload below)	*/
+				DDS_full_size += ((w+3)/4)*((h+3)/4)*block_size;
+			}
 		}
 	} else
 	{
@@ -1877,8 +1925,7 @@ int query_NPOT_capability( void )
 	{
 		/*	we haven't yet checked for the capability, do so	*/
 		if(
-			(NULL == strstr( (char const*)glGetString( GL_EXTENSIONS ),
-				"GL_ARB_texture_non_power_of_two" ) )
+			!SOIL_extension_supported( "GL_ARB_texture_non_power_of_two" )
 			)
 		{
 			/*	not there, flag the failure	*/
@@ -1900,14 +1947,11 @@ int query_tex_rectangle_capability( void )
 	{
 		/*	we haven't yet checked for the capability, do so	*/
 		if(
-			(NULL == strstr( (char const*)glGetString( GL_EXTENSIONS ),
-				"GL_ARB_texture_rectangle" ) )
+			!SOIL_extension_supported( "GL_ARB_texture_rectangle" )
 		&&
-			(NULL == strstr( (char const*)glGetString( GL_EXTENSIONS ),
-				"GL_EXT_texture_rectangle" ) )
+			!SOIL_extension_supported( "GL_EXT_texture_rectangle" )
 		&&
-			(NULL == strstr( (char const*)glGetString( GL_EXTENSIONS ),
-				"GL_NV_texture_rectangle" ) )
+			!SOIL_extension_supported( "GL_NV_texture_rectangle" )
 			)
 		{
 			/*	not there, flag the failure	*/
@@ -1929,11 +1973,9 @@ int query_cubemap_capability( void )
 	{
 		/*	we haven't yet checked for the capability, do so	*/
 		if(
-			(NULL == strstr( (char const*)glGetString( GL_EXTENSIONS ),
-				"GL_ARB_texture_cube_map" ) )
+			!SOIL_extension_supported( "GL_ARB_texture_cube_map" )
 		&&
-			(NULL == strstr( (char const*)glGetString( GL_EXTENSIONS ),
-				"GL_EXT_texture_cube_map" ) )
+			!SOIL_extension_supported( "GL_EXT_texture_cube_map" )
 			)
 		{
 			/*	not there, flag the failure	*/
@@ -1954,55 +1996,14 @@ int query_DXT_capability( void )
 	if( has_DXT_capability == SOIL_CAPABILITY_UNKNOWN )
 	{
 		/*	we haven't yet checked for the capability, do so	*/
-		if( NULL == strstr(
-				(char const*)glGetString( GL_EXTENSIONS ),
-				"GL_EXT_texture_compression_s3tc" ) )
+		if( !SOIL_extension_supported( "GL_EXT_texture_compression_s3tc" ) )
 		{
 			/*	not there, flag the failure	*/
 			has_DXT_capability = SOIL_CAPABILITY_NONE;
 		} else
 		{
 			/*	and find the address of the extension function	*/
-			P_SOIL_GLCOMPRESSEDTEXIMAGE2DPROC ext_addr = NULL;
-			#ifdef WIN32
-				ext_addr = (P_SOIL_GLCOMPRESSEDTEXIMAGE2DPROC)
-						wglGetProcAddress
-						(
-							"glCompressedTexImage2DARB"
-						);
-			#elif defined(__APPLE__) || defined(__APPLE_CC__)
-				/*	I can't test this Apple stuff!	*/
-				CFBundleRef bundle;
-				CFURLRef bundleURL =
-					CFURLCreateWithFileSystemPath(
-						kCFAllocatorDefault,
-						CFSTR("/System/Library/Frameworks/OpenGL.framework"),
-						kCFURLPOSIXPathStyle,
-						true );
-				CFStringRef extensionName =
-					CFStringCreateWithCString(
-						kCFAllocatorDefault,
-						"glCompressedTexImage2DARB",
-						kCFStringEncodingASCII );
-				bundle = CFBundleCreate( kCFAllocatorDefault, bundleURL );
-				assert( bundle != NULL );
-				ext_addr = (P_SOIL_GLCOMPRESSEDTEXIMAGE2DPROC)
-						CFBundleGetFunctionPointerForName
-						(
-							bundle, extensionName
-						);
-				CFRelease( bundleURL );
-				CFRelease( extensionName );
-				CFRelease( bundle );
-			#else
-				ext_addr = (P_SOIL_GLCOMPRESSEDTEXIMAGE2DPROC)
-						glXGetProcAddressARB
-						(
-							(const GLubyte *)"glCompressedTexImage2DARB"
-						);
-			#endif
-			/*	Flag it so no checks needed later	*/
-			if( NULL == ext_addr )
+			if( !SOIL_load_compressed_upload() )
 			{
 				/*	hmm, not good!!  This should not happen, but does on my
 					laptop's VIA chipset.  The GL_EXT_texture_compression_s3tc
@@ -2014,7 +2015,6 @@ int query_DXT_capability( void )
 			} else
 			{
 				/*	all's well!	*/
-				soilGlCompressedTexImage2D = ext_addr;
 				has_DXT_capability = SOIL_CAPABILITY_PRESENT;
 			}
 		}
@@ -2022,3 +2022,127 @@ int query_DXT_capability( void )
 	/*	let the user know if we can do DXT or not	*/
 	return has_DXT_capability;
 }
+
+int query_RGTC_capability( void )
+{
+	/*	check for the capability	*/
+	if( has_RGTC_capability == SOIL_CAPABILITY_UNKNOWN )
+	{
+		/*	we haven't yet checked for the capability, do so
+			(RGTC is core since OpenGL 3.0)	*/
+		char const *version = (char const*)glGetString( GL_VERSION );
+		if(
+			!SOIL_extension_supported( "GL_ARB_texture_compression_rgtc" )
+		&&
+			!SOIL_extension_supported( "GL_EXT_texture_compression_rgtc" )
+		&&
+			((NULL == version) || (version[0] < '3') || (version[1] != '.'))
+			)
+		{
+			/*	not there, flag the failure	*/
+			has_RGTC_capability = SOIL_CAPABILITY_NONE;
+		} else
+		if( !SOIL_load_compressed_upload() )
+		{
+			/*	no way to upload the blocks	*/
+			has_RGTC_capability = SOIL_CAPABILITY_NONE;
+		} else
+		{
+			/*	it's there!	*/
+			has_RGTC_capability = SOIL_CAPABILITY_PRESENT;
+		}
+	}
+	/*	let the user know if we can do RGTC or not	*/
+	return has_RGTC_capability;
+}
+
+int SOIL_extension_supported( const char *name )
+{
+	/*	variables	*/
+	char const *extensions;
+	size_t length = strlen( name );
+	/*	the old way, a single space separated string	*/
+	extensions = (char const*)glGetString( GL_EXTENSIONS );
+	if( NULL != extensions )
+	{
+		/*	match whole names only, not prefixes of longer ones	*/
+		char const *found = strstr( extensions, name );
+		while( NULL != found )
+		{
+			if( ((found == extensions) || (found[-1] == ' ')) &&
+				((found[length] == ' ') || (found[length] == '\0')) )
+			{
+				return 1;
+			}
+			found = strstr( found + length, name );
+		}
+		return 0;
+	} else
+	{
+		/*	core profiles only list the extensions one by one	*/
+		GLint count = 0, i;
+		P_SOIL_GLGETSTRINGIPROC get_stringi =
+			(P_SOIL_GLGETSTRINGIPROC)SOIL_get_proc_address( "glGetStringi" );
+		if( NULL == get_stringi )
+		{
+			return 0;
+		}
+		glGetIntegerv( SOIL_NUM_EXTENSIONS, &count );
+		for( i = 0; i < count; ++i )
+		{
+			char const *ext = (char const*)get_stringi( GL_EXTENSIONS, i );
+			if( (NULL != ext) && (0 == strcmp( ext, name )) )
+			{
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+void *SOIL_get_proc_address( const char *name )
+{
+	void *addr = NULL;
+	#ifdef WIN32
+		addr = (void*)wglGetProcAddress( name );
+	#elif defined(__APPLE__) || defined(__APPLE_CC__)
+		/*	I can't test this Apple stuff!	*/
+		CFBundleRef bundle;
+		CFURLRef bundleURL =
+			CFURLCreateWithFileSystemPath(
+				kCFAllocatorDefault,
+				CFSTR("/System/Library/Frameworks/OpenGL.framework"),
+				kCFURLPOSIXPathStyle,
+				true );
+		CFStringRef extensionName =
+			CFStringCreateWithCString(
+				kCFAllocatorDefault,
+				name,
+				kCFStringEncodingASCII );
+		bundle = CFBundleCreate( kCFAllocatorDefault, bundleURL );
+		assert( bundle != NULL );
+		addr = CFBundleGetFunctionPointerForName( bundle, extensionName );
+		CFRelease( bundleURL );
+		CFRelease( extensionName );
+		CFRelease( bundle );
+	#else
+		addr = (void*)glXGetProcAddressARB( (const GLubyte *)name );
+	#endif
+	return addr;
+}
+
+int SOIL_load_compressed_upload( void )
+{
+	if( NULL == soilGlCompressedTexImage2D )
+	{
+		/*	prefer the ARB entry point, fall back to the core one	*/
+		soilGlCompressedTexImage2D = (P_SOIL_GLCOMPRESSEDTEXIMAGE2DPROC)
+				SOIL_get_proc_address( "glCompressedTexImage2DARB" );
+		if( NULL == soilGlCompressedTexImage2D )
+		{
+			soilGlCompressedTexImage2D = (P_SOIL_GLCOMPRESSEDTEXIMAGE2DPROC)
+					SOIL_get_proc_address( "glCompressedTexImage2D" );
+		}
+	}
+	return NULL != soilGlCompressedTexImage2D;
+}
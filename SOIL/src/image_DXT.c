@@ -8,11 +8,21 @@
 */
 
 #include "image_DXT.h"
+#include "image_threads.h"
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
+/*	SSE2 block fitting (define DXT_NO_SIMD to remove code)	*/
+#if !defined(DXT_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define DXT_SSE2
+#include <emmintrin.h>
+#endif
+
+/*	block rows handed to each compression thread, at least	*/
+#define DXT_ROWS_PER_THREAD	16
+
 /*	set this =1 if you want to use the covarince matrix method...
 	which is better than my method of using standard deviations
 	overall, except on the infintesimal chance that the power
@@ -37,6 +47,33 @@ void compress_DDS_color_block(
 void compress_DDS_alpha_block(
 				const unsigned char *const uncompressed,
 				unsigned char compressed[8] );
+/*
+	Takes a 4x4 block of single channel values and compresses it
+	into 8 bytes of BC4 (the same layout as a DXT5 alpha block),
+	mapping every value to the nearest of the 8 levels.
+*/
+void compress_BC4_block(
+				const unsigned char uncompressed[16],
+				unsigned char compressed[8] );
+/*
+	Copies one channel of the 4x4 block at (i,j), repeating the
+	first value past the image edges, like extract_DDS_block.
+*/
+void extract_DDS_channel_block(
+				const unsigned char *const uncompressed,
+				int width, int height, int channels, int channel,
+				int i, int j,
+				unsigned char ublock[16] );
+/*
+	Copies the 4x4 block at (i,j) into an RGBA block, repeating
+	the first pixel past the image edges.  Images without alpha
+	get an opaque one.
+*/
+void extract_DDS_block(
+				const unsigned char *const uncompressed,
+				int width, int height, int channels,
+				int i, int j,
+				unsigned char ublock[16*4] );
 
 /********* Actual Exposed Functions *********/
 int
@@ -71,6 +108,10 @@ int
 		DDS_data = convert_image_to_DXT5( data, width, height, channels, &DDS_size );
 	}
 	/*	save it	*/
+	if( NULL == DDS_data )
+	{
+		return 0;
+	}
 	memset( &header, 0, sizeof( DDS_header ) );
 	header.dwMagic = ('D' << 0) | ('D' << 8) | ('S' << 16) | (' ' << 24);
 	header.dwSize = 124;
@@ -90,6 +131,11 @@ int
 	header.sCaps.dwCaps1 = DDSCAPS_TEXTURE;
 	/*	write it out	*/
 	fout = fopen( filename, "wb");
+	if( NULL == fout )
+	{
+		free( DDS_data );
+		return 0;
+	}
 	fwrite( &header, sizeof( DDS_header ), 1, fout );
 	fwrite( DDS_data, 1, DDS_size, fout );
 	fclose( fout );
@@ -98,17 +144,171 @@ int
 	return 1;
 }
 
-unsigned char* convert_image_to_DXT1(
-		const unsigned char *const uncompressed,
+int
+	save_image_as_DDS_RGTC
+	(
+		const char *filename,
 		int width, int height, int channels,
-		int *out_size )
+		int rgtc_channels,
+		const unsigned char *const data
+	)
 {
+	/*	variables	*/
+	FILE *fout;
+	unsigned char *DDS_data;
+	DDS_header header;
+	int DDS_size;
+	/*	error check	*/
+	if( (NULL == filename) ||
+		(width < 1) || (height < 1) ||
+		(channels < 1) || (channels > 4) ||
+		(rgtc_channels < 1) || (rgtc_channels > 2) ||
+		(data == NULL ) )
+	{
+		return 0;
+	}
+	/*	Convert the image	*/
+	if( rgtc_channels == 1 )
+	{
+		DDS_data = convert_image_to_BC4( data, width, height, channels, &DDS_size );
+	} else
+	{
+		DDS_data = convert_image_to_BC5( data, width, height, channels, &DDS_size );
+	}
+	if( NULL == DDS_data )
+	{
+		return 0;
+	}
+	/*	save it	*/
+	memset( &header, 0, sizeof( DDS_header ) );
+	header.dwMagic = ('D' << 0) | ('D' << 8) | ('S' << 16) | (' ' << 24);
+	header.dwSize = 124;
+	header.dwFlags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE;
+	header.dwWidth = width;
+	header.dwHeight = height;
+	header.dwPitchOrLinearSize = DDS_size;
+	header.sPixelFormat.dwSize = 32;
+	header.sPixelFormat.dwFlags = DDPF_FOURCC;
+	header.sPixelFormat.dwFourCC =
+		('A' << 0) | ('T' << 8) | ('I' << 16) | (('0' + rgtc_channels) << 24);
+	header.sCaps.dwCaps1 = DDSCAPS_TEXTURE;
+	/*	write it out	*/
+	fout = fopen( filename, "wb");
+	if( NULL == fout )
+	{
+		free( DDS_data );
+		return 0;
+	}
+	fwrite( &header, sizeof( DDS_header ), 1, fout );
+	fwrite( DDS_data, 1, DDS_size, fout );
+	fclose( fout );
+	/*	done	*/
+	free( DDS_data );
+	return 1;
+}
+
+/*	the blocks of an image, compressed a range of block rows at a time	*/
+typedef struct
+{
+	const unsigned char *uncompressed;
+	int width, height, channels;
 	unsigned char *compressed;
-	int i, j, x, y;
-	unsigned char ublock[16*3];
-	unsigned char cblock[8];
-	int index = 0, chan_step = 1;
-	int block_count = 0;
+}
+DXT_job;
+
+static void compress_DXT1_rows( void *arg, int first, int last )
+{
+	DXT_job *job = (DXT_job*)arg;
+	int blocks_x = (job->width + 3) >> 2;
+	int i, j;
+	unsigned char ublock[16*4];
+	for( j = first; j < last; ++j )
+	{
+		unsigned char *out = job->compressed + j * blocks_x * 8;
+		for( i = 0; i < blocks_x; ++i )
+		{
+			extract_DDS_block( job->uncompressed, job->width, job->height,
+					job->channels, i*4, j*4, ublock );
+			/*	compress the block straight into the main buffer	*/
+			compress_DDS_color_block( 4, ublock, out );
+			out += 8;
+		}
+	}
+}
+
+static void compress_DXT5_rows( void *arg, int first, int last )
+{
+	DXT_job *job = (DXT_job*)arg;
+	int blocks_x = (job->width + 3) >> 2;
+	int i, j;
+	unsigned char ublock[16*4];
+	for( j = first; j < last; ++j )
+	{
+		unsigned char *out = job->compressed + j * blocks_x * 16;
+		for( i = 0; i < blocks_x; ++i )
+		{
+			extract_DDS_block( job->uncompressed, job->width, job->height,
+					job->channels, i*4, j*4, ublock );
+			/*	alpha block first, then the color block	*/
+			compress_DDS_alpha_block( ublock, out );
+			compress_DDS_color_block( 4, ublock, out + 8 );
+			out += 16;
+		}
+	}
+}
+
+static void compress_BC4_rows( void *arg, int first, int last )
+{
+	DXT_job *job = (DXT_job*)arg;
+	int blocks_x = (job->width + 3) >> 2;
+	int i, j;
+	unsigned char ublock[16];
+	for( j = first; j < last; ++j )
+	{
+		unsigned char *out = job->compressed + j * blocks_x * 8;
+		for( i = 0; i < blocks_x; ++i )
+		{
+			extract_DDS_channel_block( job->uncompressed, job->width, job->height,
+					job->channels, 0, i*4, j*4, ublock );
+			compress_BC4_block( ublock, out );
+			out += 8;
+		}
+	}
+}
+
+static void compress_BC5_rows( void *arg, int first, int last )
+{
+	DXT_job *job = (DXT_job*)arg;
+	int blocks_x = (job->width + 3) >> 2;
+	/*	a single channel image repeats it in both halves	*/
+	int second = job->channels > 1 ? 1 : 0;
+	int i, j;
+	unsigned char ublock[16];
+	for( j = first; j < last; ++j )
+	{
+		unsigned char *out = job->compressed + j * blocks_x * 16;
+		for( i = 0; i < blocks_x; ++i )
+		{
+			/*	red block first, then the green block	*/
+			extract_DDS_channel_block( job->uncompressed, job->width, job->height,
+					job->channels, 0, i*4, j*4, ublock );
+			compress_BC4_block( ublock, out );
+			extract_DDS_channel_block( job->uncompressed, job->width, job->height,
+					job->channels, second, i*4, j*4, ublock );
+			compress_BC4_block( ublock, out + 8 );
+			out += 16;
+		}
+	}
+}
+
+/*	error checks, allocates the blocks and compresses all block rows	*/
+static unsigned char* convert_image_to_blocks(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int *out_size,
+		int block_bytes, parallel_job compress_rows )
+{
+	DXT_job job;
 	/*	error check	*/
 	*out_size = 0;
 	if( (width < 1) || (height < 1) ||
@@ -117,164 +317,279 @@ unsigned char* convert_image_to_DXT1(
 	{
 		return NULL;
 	}
+	/*	get the RAM for the compressed image	*/
+	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * block_bytes;
+	job.uncompressed = uncompressed;
+	job.width = width;
+	job.height = height;
+	job.channels = channels;
+	job.compressed = (unsigned char*)malloc( *out_size );
+	if( NULL == job.compressed )
+	{
+		*out_size = 0;
+		return NULL;
+	}
+	/*	go through each block row	*/
+	parallel_for( (height+3) >> 2, DXT_ROWS_PER_THREAD, compress_rows, &job );
+	return job.compressed;
+}
+
+/*
+	All converters split the image into rows of 4x4 blocks and
+	compress those on several threads (see image_threads.h).
+*/
+unsigned char* convert_image_to_DXT1(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int *out_size )
+{
+	/*	8 bytes per 4x4 pixel block	*/
+	return convert_image_to_blocks( uncompressed, width, height, channels,
+			out_size, 8, compress_DXT1_rows );
+}
+
+unsigned char* convert_image_to_DXT5(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int *out_size )
+{
+	/*	16 bytes per 4x4 pixel block	*/
+	return convert_image_to_blocks( uncompressed, width, height, channels,
+			out_size, 16, compress_DXT5_rows );
+}
+
+unsigned char* convert_image_to_BC4(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int *out_size )
+{
+	/*	8 bytes per 4x4 pixel block	*/
+	return convert_image_to_blocks( uncompressed, width, height, channels,
+			out_size, 8, compress_BC4_rows );
+}
+
+unsigned char* convert_image_to_BC5(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int *out_size )
+{
+	/*	16 bytes per 4x4 pixel block	*/
+	return convert_image_to_blocks( uncompressed, width, height, channels,
+			out_size, 16, compress_BC5_rows );
+}
+
+/********* Helper Functions *********/
+void extract_DDS_block(
+		const unsigned char *const uncompressed,
+		int width, int height, int channels,
+		int i, int j,
+		unsigned char ublock[16*4] )
+{
+	int x, y;
+	int idx = 0, chan_step = 1;
+	int mx = 4, my = 4;
+	/*	# channels = 1 or 3 have no alpha, 2 & 4 do have alpha	*/
+	int has_alpha = 1 - (channels & 1);
 	/*	for channels == 1 or 2, I do not step forward for R,G,B values	*/
 	if( channels < 3 )
 	{
 		chan_step = 0;
 	}
-	/*	get the RAM for the compressed image
-		(8 bytes per 4x4 pixel block)	*/
-	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 8;
-	compressed = (unsigned char*)malloc( *out_size );
-	/*	go through each block	*/
-	for( j = 0; j < height; j += 4 )
+	if( j+4 >= height )
+	{
+		my = height - j;
+	}
+	if( i+4 >= width )
 	{
-		for( i = 0; i < width; i += 4 )
+		mx = width - i;
+	}
+	for( y = 0; y < my; ++y )
+	{
+		const unsigned char *row = uncompressed + ((j+y)*width + i)*channels;
+		for( x = 0; x < mx; ++x )
 		{
-			/*	copy this block into a new one	*/
-			int idx = 0;
-			int mx = 4, my = 4;
-			if( j+4 >= height )
-			{
-				my = height - j;
-			}
-			if( i+4 >= width )
-			{
-				mx = width - i;
-			}
-			for( y = 0; y < my; ++y )
-			{
-				for( x = 0; x < mx; ++x )
-				{
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step+chan_step];
-				}
-				for( x = mx; x < 4; ++x )
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-				}
-			}
-			for( y = my; y < 4; ++y )
-			{
-				for( x = 0; x < 4; ++x )
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-				}
-			}
-			/*	compress the block	*/
-			++block_count;
-			compress_DDS_color_block( 3, ublock, cblock );
-			/*	copy the data from the block into the main block	*/
-			for( x = 0; x < 8; ++x )
-			{
-				compressed[index++] = cblock[x];
-			}
+			ublock[idx++] = row[x*channels];
+			ublock[idx++] = row[x*channels+chan_step];
+			ublock[idx++] = row[x*channels+chan_step+chan_step];
+			ublock[idx++] =
+				has_alpha * row[x*channels+channels-1]
+				+ (1-has_alpha)*255;
+		}
+		for( x = mx; x < 4; ++x )
+		{
+			ublock[idx++] = ublock[0];
+			ublock[idx++] = ublock[1];
+			ublock[idx++] = ublock[2];
+			ublock[idx++] = ublock[3];
+		}
+	}
+	for( y = my; y < 4; ++y )
+	{
+		for( x = 0; x < 4; ++x )
+		{
+			ublock[idx++] = ublock[0];
+			ublock[idx++] = ublock[1];
+			ublock[idx++] = ublock[2];
+			ublock[idx++] = ublock[3];
 		}
 	}
-	return compressed;
 }
 
-unsigned char* convert_image_to_DXT5(
+void extract_DDS_channel_block(
 		const unsigned char *const uncompressed,
-		int width, int height, int channels,
-		int *out_size )
+		int width, int height, int channels, int channel,
+		int i, int j,
+		unsigned char ublock[16] )
 {
-	unsigned char *compressed;
-	int i, j, x, y;
-	unsigned char ublock[16*4];
-	unsigned char cblock[8];
-	int index = 0, chan_step = 1;
-	int block_count = 0, has_alpha;
-	/*	error check	*/
-	*out_size = 0;
-	if( (width < 1) || (height < 1) ||
-		(NULL == uncompressed) ||
-		(channels < 1) || ( channels > 4) )
+	int x, y;
+	int idx = 0;
+	int mx = 4, my = 4;
+	if( j+4 >= height )
 	{
-		return NULL;
+		my = height - j;
 	}
-	/*	for channels == 1 or 2, I do not step forward for R,G,B vales	*/
-	if( channels < 3 )
+	if( i+4 >= width )
 	{
-		chan_step = 0;
+		mx = width - i;
 	}
-	/*	# channels = 1 or 3 have no alpha, 2 & 4 do have alpha	*/
-	has_alpha = 1 - (channels & 1);
-	/*	get the RAM for the compressed image
-		(16 bytes per 4x4 pixel block)	*/
-	*out_size = ((width+3) >> 2) * ((height+3) >> 2) * 16;
-	compressed = (unsigned char*)malloc( *out_size );
-	/*	go through each block	*/
-	for( j = 0; j < height; j += 4 )
-	{
-		for( i = 0; i < width; i += 4 )
+	for( y = 0; y < my; ++y )
+	{
+		const unsigned char *row = uncompressed + ((j+y)*width + i)*channels + channel;
+		for( x = 0; x < mx; ++x )
 		{
-			/*	local variables, and my block counter	*/
-			int idx = 0;
-			int mx = 4, my = 4;
-			if( j+4 >= height )
-			{
-				my = height - j;
-			}
-			if( i+4 >= width )
-			{
-				mx = width - i;
-			}
-			for( y = 0; y < my; ++y )
-			{
-				for( x = 0; x < mx; ++x )
-				{
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step];
-					ublock[idx++] = uncompressed[(j+y)*width*channels+(i+x)*channels+chan_step+chan_step];
-					ublock[idx++] =
-						has_alpha * uncompressed[(j+y)*width*channels+(i+x)*channels+channels-1]
-						+ (1-has_alpha)*255;
-				}
-				for( x = mx; x < 4; ++x )
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-					ublock[idx++] = ublock[3];
-				}
-			}
-			for( y = my; y < 4; ++y )
-			{
-				for( x = 0; x < 4; ++x )
-				{
-					ublock[idx++] = ublock[0];
-					ublock[idx++] = ublock[1];
-					ublock[idx++] = ublock[2];
-					ublock[idx++] = ublock[3];
-				}
-			}
-			/*	now compress the alpha block	*/
-			compress_DDS_alpha_block( ublock, cblock );
-			/*	copy the data from the compressed alpha block into the main buffer	*/
-			for( x = 0; x < 8; ++x )
-			{
-				compressed[index++] = cblock[x];
-			}
-			/*	then compress the color block	*/
-			++block_count;
-			compress_DDS_color_block( 4, ublock, cblock );
-			/*	copy the data from the compressed color block into the main buffer	*/
-			for( x = 0; x < 8; ++x )
-			{
-				compressed[index++] = cblock[x];
-			}
+			ublock[idx++] = row[x*channels];
 		}
+		for( x = mx; x < 4; ++x )
+		{
+			ublock[idx++] = ublock[0];
+		}
+	}
+	for( ; idx < 16; ++idx )
+	{
+		ublock[idx] = ublock[0];
 	}
-	return compressed;
 }
 
-/********* Helper Functions *********/
+#ifdef DXT_SSE2
+/*
+	SSE2 versions of the block statistics, for 16 RGBA pixels.
+	All sums are of integers, so they come out exactly as the
+	scalar float sums do; the projections are done in the same
+	order as the scalar code, so the blocks are bit-identical.
+*/
+static int hsum_epi32( __m128i x )
+{
+	x = _mm_add_epi32( x, _mm_shuffle_epi32( x, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+	x = _mm_add_epi32( x, _mm_shuffle_epi32( x, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+	return _mm_cvtsi128_si32( x );
+}
+
+/*	split 16 RGBA pixels into R, G and B planes of 32 bit lanes	*/
+static void load_block_planes( const unsigned char *const uncompressed,
+		__m128i r[4], __m128i g[4], __m128i b[4] )
+{
+	const __m128i lo = _mm_set1_epi32( 255 );
+	int i;
+	for( i = 0; i < 4; ++i )
+	{
+		__m128i px = _mm_loadu_si128( (const __m128i*)(uncompressed + 16*i) );
+		r[i] = _mm_and_si128( px, lo );
+		g[i] = _mm_and_si128( _mm_srli_epi32( px, 8 ), lo );
+		b[i] = _mm_and_si128( _mm_srli_epi32( px, 16 ), lo );
+	}
+}
+
+static void compute_color_sums_SSE2(
+		const unsigned char *const uncompressed,
+		float sums[9] )
+{
+	__m128i r[4], g[4], b[4];
+	__m128i r16[2], g16[2], b16[2];
+	__m128i acc[9];
+	const __m128i one = _mm_set1_epi16( 1 );
+	int i;
+	load_block_planes( uncompressed, r, g, b );
+	/*	8 pixels per register, products summed pairwise by madd	*/
+	for( i = 0; i < 2; ++i )
+	{
+		r16[i] = _mm_packs_epi32( r[2*i], r[2*i+1] );
+		g16[i] = _mm_packs_epi32( g[2*i], g[2*i+1] );
+		b16[i] = _mm_packs_epi32( b[2*i], b[2*i+1] );
+	}
+	for( i = 0; i < 9; ++i )
+	{
+		acc[i] = _mm_setzero_si128();
+	}
+	for( i = 0; i < 2; ++i )
+	{
+		acc[0] = _mm_add_epi32( acc[0], _mm_madd_epi16( r16[i], one ) );
+		acc[1] = _mm_add_epi32( acc[1], _mm_madd_epi16( g16[i], one ) );
+		acc[2] = _mm_add_epi32( acc[2], _mm_madd_epi16( b16[i], one ) );
+		acc[3] = _mm_add_epi32( acc[3], _mm_madd_epi16( r16[i], r16[i] ) );
+		acc[4] = _mm_add_epi32( acc[4], _mm_madd_epi16( g16[i], g16[i] ) );
+		acc[5] = _mm_add_epi32( acc[5], _mm_madd_epi16( b16[i], b16[i] ) );
+		acc[6] = _mm_add_epi32( acc[6], _mm_madd_epi16( r16[i], g16[i] ) );
+		acc[7] = _mm_add_epi32( acc[7], _mm_madd_epi16( r16[i], b16[i] ) );
+		acc[8] = _mm_add_epi32( acc[8], _mm_madd_epi16( g16[i], b16[i] ) );
+	}
+	for( i = 0; i < 9; ++i )
+	{
+		sums[i] = (float)hsum_epi32( acc[i] );
+	}
+}
+
+static void project_min_max_SSE2(
+		const unsigned char *const uncompressed,
+		const float direction[3],
+		float *dot_min, float *dot_max )
+{
+	__m128i r[4], g[4], b[4];
+	__m128 lo, hi;
+	const __m128 dr = _mm_set1_ps( direction[0] );
+	const __m128 dg = _mm_set1_ps( direction[1] );
+	const __m128 db = _mm_set1_ps( direction[2] );
+	int i;
+	load_block_planes( uncompressed, r, g, b );
+	for( i = 0; i < 4; ++i )
+	{
+		__m128 dot = _mm_add_ps(
+				_mm_add_ps(
+					_mm_mul_ps( dr, _mm_cvtepi32_ps( r[i] ) ),
+					_mm_mul_ps( dg, _mm_cvtepi32_ps( g[i] ) ) ),
+				_mm_mul_ps( db, _mm_cvtepi32_ps( b[i] ) ) );
+		lo = i ? _mm_min_ps( lo, dot ) : dot;
+		hi = i ? _mm_max_ps( hi, dot ) : dot;
+	}
+	lo = _mm_min_ps( lo, _mm_shuffle_ps( lo, lo, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+	lo = _mm_min_ps( lo, _mm_shuffle_ps( lo, lo, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+	hi = _mm_max_ps( hi, _mm_shuffle_ps( hi, hi, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+	hi = _mm_max_ps( hi, _mm_shuffle_ps( hi, hi, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+	*dot_min = _mm_cvtss_f32( lo );
+	*dot_max = _mm_cvtss_f32( hi );
+}
+
+static void alpha_min_max_SSE2(
+		const unsigned char *const uncompressed,
+		int *a_min, int *a_max )
+{
+	__m128i lo, hi;
+	int i;
+	for( i = 0; i < 4; ++i )
+	{
+		__m128i a = _mm_srli_epi32(
+				_mm_loadu_si128( (const __m128i*)(uncompressed + 16*i) ), 24 );
+		lo = i ? _mm_min_epi16( lo, a ) : a;
+		hi = i ? _mm_max_epi16( hi, a ) : a;
+	}
+	lo = _mm_min_epi16( lo, _mm_shuffle_epi32( lo, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+	lo = _mm_min_epi16( lo, _mm_shuffle_epi32( lo, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+	hi = _mm_max_epi16( hi, _mm_shuffle_epi32( hi, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+	hi = _mm_max_epi16( hi, _mm_shuffle_epi32( hi, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+	*a_min = _mm_cvtsi128_si32( lo );
+	*a_max = _mm_cvtsi128_si32( hi );
+}
+#endif
+
 int convert_bit_range( int c, int from_bits, int to_bits )
 {
 	int b = (1 << (from_bits - 1)) + c * ((1 << to_bits) - 1);
@@ -308,6 +623,16 @@ void compute_color_line_STDEV(
 	float sum_rg = 0.0f, sum_rb = 0.0f, sum_gb = 0.0f;
 	/*	calculate all data needed for the covariance matrix
 		( to compare with _rygdxt code)	*/
+	#ifdef DXT_SSE2
+	if( channels == 4 )
+	{
+		float sums[9];
+		compute_color_sums_SSE2( uncompressed, sums );
+		sum_r = sums[0]; sum_g = sums[1]; sum_b = sums[2];
+		sum_rr = sums[3]; sum_gg = sums[4]; sum_bb = sums[5];
+		sum_rg = sums[6]; sum_rb = sums[7]; sum_gb = sums[8];
+	} else
+	#endif
 	for( i = 0; i < 16*channels; i += channels )
 	{
 		sum_r += uncompressed[i+0];
@@ -431,6 +756,13 @@ void LSE_master_colors_max_min(
 	vec_len2 = 1.0f / ( 0.00001f +
 			sum_x2[0]*sum_x2[0] + sum_x2[1]*sum_x2[1] + sum_x2[2]*sum_x2[2] );
 	/*	finding the max and min vector values	*/
+	#ifdef DXT_SSE2
+	if( channels == 4 )
+	{
+		project_min_max_SSE2( uncompressed, sum_x2, &dot_min, &dot_max );
+	} else
+	#endif
+	{
 	dot_max =
 			(
 				sum_x2[0] * uncompressed[0] +
@@ -454,6 +786,7 @@ void LSE_master_colors_max_min(
 			dot_max = dot;
 		}
 	}
+	}
 	/*	and the offset (from the average location)	*/
 	dot = sum_x2[0]*sum_x[0] + sum_x2[1]*sum_x[1] + sum_x2[2]*sum_x[2];
 	dot_min -= dot;
@@ -589,6 +922,9 @@ void
 	/*	stupid order	*/
 	int swizzle8[] = { 1, 7, 6, 5, 4, 3, 2, 0 };
 	/*	get the alpha limits (a0 > a1)	*/
+	#ifdef DXT_SSE2
+	alpha_min_max_SSE2( uncompressed, &a1, &a0 );
+	#else
 	a0 = a1 = uncompressed[3];
 	for( i = 4+3; i < 16*4; i += 4 )
 	{
@@ -600,6 +936,7 @@ void
 			a1 = uncompressed[i];
 		}
 	}
+	#endif
 	/*	store those limits, and zero the rest of the compressed dataset	*/
 	compressed[0] = a0;
 	compressed[1] = a1;
@@ -610,9 +947,10 @@ void
 	compressed[5] = 0;
 	compressed[6] = 0;
 	compressed[7] = 0;
-	/*	store the all of the alpha values	*/
+	/*	store the all of the alpha values
+		(a flat block maps everything to index 0, i.e. a1)	*/
 	next_bit = 8*2;
-	scale_me = 7.9999f / (a0 - a1);
+	scale_me = (a0 > a1) ? 7.9999f / (a0 - a1) : 0.0f;
 	for( i = 3; i < 16*4; i += 4 )
 	{
 		/*	convert this alpha value to a 3 bit number	*/
@@ -630,3 +968,58 @@ void
 	}
 	/*	done compressing to DXT1	*/
 }
+
+void
+	compress_BC4_block
+	(
+		const unsigned char uncompressed[16],
+		unsigned char compressed[8]
+	)
+{
+	/*	variables	*/
+	int i;
+	int next_bit;
+	int a0, a1;
+	float scale_me = 0.0f;
+	/*	stupid order	*/
+	int swizzle8[] = { 1, 7, 6, 5, 4, 3, 2, 0 };
+	/*	get the limits (a0 >= a1, so the 8 level mode is used)	*/
+	a0 = a1 = uncompressed[0];
+	for( i = 1; i < 16; ++i )
+	{
+		if( uncompressed[i] > a0 )
+		{
+			a0 = uncompressed[i];
+		} else if( uncompressed[i] < a1 )
+		{
+			a1 = uncompressed[i];
+		}
+	}
+	/*	store those limits, and zero the rest of the compressed dataset	*/
+	compressed[0] = a0;
+	compressed[1] = a1;
+	for( i = 2; i < 8; ++i )
+	{
+		compressed[i] = 0;
+	}
+	/*	a flat block decodes the same for any index	*/
+	if( a0 > a1 )
+	{
+		scale_me = 7.0f / (a0 - a1);
+	}
+	next_bit = 8*2;
+	for( i = 0; i < 16; ++i )
+	{
+		/*	round to the nearest of the 8 levels from a1 to a0	*/
+		int value = (int)((uncompressed[i] - a1) * scale_me + 0.5f);
+		int svalue = swizzle8[ value&7 ];
+		compressed[next_bit >> 3] |= svalue << (next_bit & 7);
+		if( (next_bit & 7) > 5 )
+		{
+			/*	spans 2 bytes, fill in the start of the 2nd byte	*/
+			compressed[1 + (next_bit >> 3)] |= svalue >> (8 - (next_bit & 7) );
+		}
+		next_bit += 3;
+	}
+	/*	done compressing to BC4	*/
+}
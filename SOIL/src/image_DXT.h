@@ -23,6 +23,22 @@ save_image_as_DDS
     const unsigned char *const data
 );
 
+/**
+	Converts the first channel of an image (BC4) or its first two
+	channels (BC5) to RGTC, then saves the converted image to disk.
+	Meant for height maps and two channel normal maps.
+	\param rgtc_channels 1 for BC4 (ATI1), 2 for BC5 (ATI2)
+	\return 0 if failed, otherwise returns 1
+**/
+int
+save_image_as_DDS_RGTC
+(
+    const char *filename,
+    int width, int height, int channels,
+    int rgtc_channels,
+    const unsigned char *const data
+);
+
 /**
 	take an image and convert it to DXT1 (no alpha)
 **/
@@ -45,6 +61,30 @@ convert_image_to_DXT5
     int *out_size
 );
 
+/**
+	take the first channel of an image and convert it to BC4
+	(RGTC1, 8 bytes per 4x4 block)
+**/
+unsigned char*
+convert_image_to_BC4
+(
+    const unsigned char *const uncompressed,
+    int width, int height, int channels,
+    int *out_size
+);
+
+/**
+	take the first two channels of an image and convert them to BC5
+	(RGTC2, 16 bytes per 4x4 block)
+**/
+unsigned char*
+convert_image_to_BC5
+(
+    const unsigned char *const uncompressed,
+    int width, int height, int channels,
+    int *out_size
+);
+
 /**	A bunch of DirectDraw Surface structures and flags **/
 typedef struct
 {
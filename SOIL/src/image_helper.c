@@ -8,8 +8,111 @@
 
 #include "image_helper.h"
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
+/*	SSE2 kernels (define IMAGE_HELPER_NO_SIMD to remove code),
+	they produce exactly the same bytes as the scalar loops	*/
+#if !defined(IMAGE_HELPER_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define IMAGE_HELPER_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef IMAGE_HELPER_SSE2
+/*
+	The same bilinear interpolation as below, 4 output bytes at a time.
+	The source offset and weight of every byte in a row are computed
+	once, and every lane does the scalar operations in the same order.
+	\return 0 if it could not run (the caller falls back to scalar code)
+*/
+static int up_scale_image_SSE2(
+		const unsigned char* const orig,
+		int width, int height, int channels,
+		unsigned char* resampled,
+		int resampled_width, int resampled_height )
+{
+	float dx, dy;
+	int x, y, c, e;
+	int row_size = resampled_width * channels;
+	int *offset = (int*)malloc( row_size * sizeof( int ) );
+	float *frac = (float*)malloc( row_size * sizeof( float ) );
+	if( (NULL == offset) || (NULL == frac) )
+	{
+		free( offset );
+		free( frac );
+		return 0;
+	}
+	dx = (width - 1.0f) / (resampled_width - 1.0f);
+	dy = (height - 1.0f) / (resampled_height - 1.0f);
+	for( x = 0; x < resampled_width; ++x )
+	{
+		float samplex = x * dx;
+		int intx = (int)samplex;
+		if( intx > width - 2 ) { intx = width - 2; }
+		samplex -= intx;
+		for( c = 0; c < channels; ++c )
+		{
+			offset[x*channels + c] = intx * channels + c;
+			frac[x*channels + c] = samplex;
+		}
+	}
+	for( y = 0; y < resampled_height; ++y )
+	{
+		float sampley = y * dy;
+		int inty = (int)sampley;
+		const unsigned char *row0, *row1;
+		unsigned char *out = resampled + y*row_size;
+		__m128 wy0, wy1;
+		if( inty > height - 2 ) { inty = height - 2; }
+		sampley -= inty;
+		wy0 = _mm_set1_ps( 1.0f - sampley );
+		wy1 = _mm_set1_ps( sampley );
+		row0 = orig + inty * width * channels;
+		row1 = row0 + width * channels;
+		for( e = 0; e + 4 <= row_size; e += 4 )
+		{
+			const int *o = offset + e;
+			__m128 wx1 = _mm_loadu_ps( frac + e );
+			__m128 wx0 = _mm_sub_ps( _mm_set1_ps( 1.0f ), wx1 );
+			__m128 value = _mm_set1_ps( 0.5f );
+			__m128i packed;
+			unsigned int v;
+			value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( _mm_cvtepi32_ps( _mm_setr_epi32(
+				row0[o[0]], row0[o[1]], row0[o[2]], row0[o[3]] ) ), wx0 ), wy0 ) );
+			value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( _mm_cvtepi32_ps( _mm_setr_epi32(
+				row0[o[0]+channels], row0[o[1]+channels], row0[o[2]+channels], row0[o[3]+channels] ) ), wx1 ), wy0 ) );
+			value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( _mm_cvtepi32_ps( _mm_setr_epi32(
+				row1[o[0]], row1[o[1]], row1[o[2]], row1[o[3]] ) ), wx0 ), wy1 ) );
+			value = _mm_add_ps( value, _mm_mul_ps( _mm_mul_ps( _mm_cvtepi32_ps( _mm_setr_epi32(
+				row1[o[0]+channels], row1[o[1]+channels], row1[o[2]+channels], row1[o[3]+channels] ) ), wx1 ), wy1 ) );
+			packed = _mm_cvttps_epi32( value );
+			packed = _mm_packs_epi32( packed, packed );
+			packed = _mm_packus_epi16( packed, packed );
+			v = (unsigned int)_mm_cvtsi128_si32( packed );
+			memcpy( out + e, &v, 4 );
+		}
+		/*	the last few bytes of the row	*/
+		for( ; e < row_size; ++e )
+		{
+			float samplex = frac[e];
+			float value = 0.5f;
+			value += row0[offset[e]]
+						*(1.0f-samplex)*(1.0f-sampley);
+			value += row0[offset[e]+channels]
+						*(samplex)*(1.0f-sampley);
+			value += row1[offset[e]]
+						*(1.0f-samplex)*(sampley);
+			value += row1[offset[e]+channels]
+						*(samplex)*(sampley);
+			out[e] = (unsigned char)(value);
+		}
+	}
+	free( offset );
+	free( frac );
+	return 1;
+}
+#endif
+
 /*	Upscaling the image uses simple bilinear interpolation	*/
 int
 	up_scale_image
@@ -32,6 +135,14 @@ int
         /*	signify badness	*/
         return 0;
     }
+	#ifdef IMAGE_HELPER_SSE2
+	if( (width > 1) && (height > 1) &&
+		up_scale_image_SSE2( orig, width, height, channels,
+			resampled, resampled_width, resampled_height ) )
+	{
+		return 1;
+	}
+	#endif
     /*
 		for each given pixel in the new map, find the exact location
 		from the original map which would contribute to this guy
@@ -177,8 +288,45 @@ int
 	}
 	/*	for channels = 2 or 4, ignore the alpha component	*/
 	nc -= 1 - (channels & 1);
+	i = 0;
+	#ifdef IMAGE_HELPER_SSE2
+	if( channels <= 4 )
+	{
+		/*	16 bytes at a time, 15 + ((141*v + 81) * 401) >> 16 is
+			exactly the LUT, and the alpha bytes are masked back in	*/
+		__m128i zero = _mm_setzero_si128();
+		__m128i mul = _mm_set1_epi16( 141 );
+		__m128i bias = _mm_set1_epi16( 81 );
+		__m128i scale = _mm_set1_epi16( 401 );
+		__m128i offset = _mm_set1_epi16( 15 );
+		__m128i keep;
+		if( channels == 2 )
+		{
+			keep = _mm_set1_epi16( (short)0xFF00 );
+		} else if( channels == 4 )
+		{
+			keep = _mm_set1_epi32( (int)0xFF000000 );
+		} else
+		{
+			keep = zero;
+		}
+		for( ; i + 16 <= width*height*channels; i += 16 )
+		{
+			__m128i v = _mm_loadu_si128( (const __m128i*)(orig + i) );
+			__m128i lo = _mm_unpacklo_epi8( v, zero );
+			__m128i hi = _mm_unpackhi_epi8( v, zero );
+			lo = _mm_add_epi16( _mm_mullo_epi16( lo, mul ), bias );
+			hi = _mm_add_epi16( _mm_mullo_epi16( hi, mul ), bias );
+			lo = _mm_add_epi16( _mm_mulhi_epu16( lo, scale ), offset );
+			hi = _mm_add_epi16( _mm_mulhi_epu16( hi, scale ), offset );
+			lo = _mm_packus_epi16( lo, hi );
+			v = _mm_or_si128( _mm_and_si128( keep, v ), _mm_andnot_si128( keep, lo ) );
+			_mm_storeu_si128( (__m128i*)(orig + i), v );
+		}
+	}
+	#endif
 	/*	OK, go through the image and scale any non-alpha components	*/
-	for( i = 0; i < width*height*channels; i += channels )
+	for( ; i < width*height*channels; i += channels )
 	{
 		for( j = 0; j < nc; ++j )
 		{
@@ -190,6 +338,73 @@ int
 
 unsigned char clamp_byte( int x ) { return ( (x) < 0 ? (0) : ( (x) > 255 ? 255 : (x) ) ); }
 
+#ifdef IMAGE_HELPER_SSE2
+/*
+	The YCoCg conversions of RGBA images work on 4 pixels at a time, one
+	per 32 bit lane.  All intermediate values fit in 16 bits, so the 16
+	bit min / max clamp every lane just like clamp_byte.  (RGB pixels
+	straddle the lanes, gathering them costs as much as the scalar loop)
+*/
+static __m128i clamp_byte_SSE2( __m128i x )
+{
+	return _mm_min_epi16( _mm_max_epi16( x, _mm_setzero_si128() ), _mm_set1_epi32( 255 ) );
+}
+
+/*	\return the number of bytes converted	*/
+static int convert_RGBA_to_YCoCg_SSE2( unsigned char* orig, int size )
+{
+	__m128i byte = _mm_set1_epi32( 255 );
+	__m128i one = _mm_set1_epi32( 1 );
+	__m128i two = _mm_set1_epi32( 2 );
+	__m128i half = _mm_set1_epi32( 128 );
+	int i;
+	for( i = 0; i + 16 <= size; i += 16 )
+	{
+		__m128i p = _mm_loadu_si128( (const __m128i*)(orig + i) );
+		__m128i r = _mm_and_si128( p, byte );
+		__m128i g = _mm_and_si128( _mm_srli_epi32( p, 8 ), byte );
+		__m128i b = _mm_and_si128( _mm_srli_epi32( p, 16 ), byte );
+		__m128i a = _mm_srli_epi32( p, 24 );
+		__m128i tmp = _mm_srai_epi32( _mm_add_epi32( _mm_add_epi32( two, r ), b ), 2 );
+		__m128i co, y, cg;
+		g = _mm_srai_epi32( _mm_add_epi32( g, one ), 1 );
+		co = clamp_byte_SSE2( _mm_add_epi32( half,
+			_mm_srai_epi32( _mm_add_epi32( _mm_sub_epi32( r, b ), one ), 1 ) ) );
+		y = clamp_byte_SSE2( _mm_add_epi32( g, tmp ) );
+		cg = clamp_byte_SSE2( _mm_sub_epi32( _mm_add_epi32( half, g ), tmp ) );
+		/*	CoCgAY	*/
+		_mm_storeu_si128( (__m128i*)(orig + i), _mm_or_si128(
+			_mm_or_si128( co, _mm_slli_epi32( cg, 8 ) ),
+			_mm_or_si128( _mm_slli_epi32( a, 16 ), _mm_slli_epi32( y, 24 ) ) ) );
+	}
+	return i;
+}
+
+/*	\return the number of bytes converted	*/
+static int convert_YCoCg_to_RGBA_SSE2( unsigned char* orig, int size )
+{
+	__m128i byte = _mm_set1_epi32( 255 );
+	__m128i half = _mm_set1_epi32( 128 );
+	int i;
+	for( i = 0; i + 16 <= size; i += 16 )
+	{
+		__m128i p = _mm_loadu_si128( (const __m128i*)(orig + i) );
+		__m128i co = _mm_sub_epi32( _mm_and_si128( p, byte ), half );
+		__m128i cg = _mm_sub_epi32( _mm_and_si128( _mm_srli_epi32( p, 8 ), byte ), half );
+		__m128i a = _mm_and_si128( _mm_srli_epi32( p, 16 ), byte );
+		__m128i y = _mm_srli_epi32( p, 24 );
+		__m128i r = clamp_byte_SSE2( _mm_sub_epi32( _mm_add_epi32( y, co ), cg ) );
+		__m128i g = clamp_byte_SSE2( _mm_add_epi32( y, cg ) );
+		__m128i b = clamp_byte_SSE2( _mm_sub_epi32( _mm_sub_epi32( y, co ), cg ) );
+		/*	RGBA	*/
+		_mm_storeu_si128( (__m128i*)(orig + i), _mm_or_si128(
+			_mm_or_si128( r, _mm_slli_epi32( g, 8 ) ),
+			_mm_or_si128( _mm_slli_epi32( b, 16 ), _mm_slli_epi32( a, 24 ) ) ) );
+	}
+	return i;
+}
+#endif
+
 /*
 	This function takes the RGB components of the image
 	and converts them into YCoCg.  3 components will be
@@ -204,7 +419,7 @@ int
 		int width, int height, int channels
 	)
 {
-	int i;
+	int i = 0;
 	/*	error check	*/
 	if( (width < 1) || (height < 1) ||
 		(channels < 3) || (channels > 4) ||
@@ -231,7 +446,10 @@ int
 		}
 	} else
 	{
-		for( i = 0; i < width*height*4; i += 4 )
+		#ifdef IMAGE_HELPER_SSE2
+		i = convert_RGBA_to_YCoCg_SSE2( orig, width*height*4 );
+		#endif
+		for( ; i < width*height*4; i += 4 )
 		{
 			int r = orig[i+0];
 			int g = (orig[i+1] + 1) >> 1;
@@ -263,7 +481,7 @@ int
 		int width, int height, int channels
 	)
 {
-	int i;
+	int i = 0;
 	/*	error check	*/
 	if( (width < 1) || (height < 1) ||
 		(channels < 3) || (channels > 4) ||
@@ -289,7 +507,10 @@ int
 		}
 	} else
 	{
-		for( i = 0; i < width*height*4; i += 4 )
+		#ifdef IMAGE_HELPER_SSE2
+		i = convert_YCoCg_to_RGBA_SSE2( orig, width*height*4 );
+		#endif
+		for( ; i < width*height*4; i += 4 )
 		{
 			int co = orig[i+0] - 128;
 			int cg = orig[i+1] - 128;
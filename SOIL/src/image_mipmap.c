@@ -0,0 +1,523 @@
+/*
+    MIPmap chain generation with selectable filters
+
+    MIT license
+*/
+
+#include "image_mipmap.h"
+#include "image_threads.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*	SSE2 filtering (define MIPMAP_NO_SIMD to remove code)	*/
+#if !defined(MIPMAP_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define MIPMAP_SSE2
+#include <emmintrin.h>
+#endif
+
+/*	output rows handed to each filtering thread, at least	*/
+#define MIPMAP_ROWS_PER_THREAD	8
+
+/*	radius of the windowed sinc filters, in texels of the smaller level	*/
+#define MIPMAP_SINC_RADIUS	3.0f
+#define MIPMAP_KAISER_ALPHA	4.0f
+
+/*	sRGB byte -> linear float, and the linear values halfway between bytes	*/
+static float srgb_to_linear[256];
+static float srgb_threshold[255];
+static int srgb_tables_ready = 0;
+
+/*
+	The source taps of every texel along one axis, always "taps" of them,
+	padded with zero weights that point at a tap which is used anyway.
+*/
+typedef struct
+{
+	int taps;
+	int *index;
+	float *weight;
+}
+filter_axis;
+
+typedef struct
+{
+	const float *src;
+	int src_w, channels;
+	float *dst;
+	unsigned char *dst8;
+	int dst_w;
+	const filter_axis *horizontal;
+	const filter_axis *vertical;
+	int max_mode;
+	int srgb_channels;
+}
+mip_job;
+
+typedef struct
+{
+	const unsigned char *src8;
+	float *dst;
+	int width, channels;
+	int srgb_channels;
+}
+decode_job;
+
+/********* Helper Functions *********/
+static float srgb_decode( float c )
+{
+	return c <= 0.04045f ? c / 12.92f : (float)pow( (c + 0.055f) / 1.055f, 2.4 );
+}
+
+static void build_srgb_tables( void )
+{
+	int i;
+	if( srgb_tables_ready )
+	{
+		return;
+	}
+	for( i = 0; i < 256; ++i )
+	{
+		srgb_to_linear[i] = srgb_decode( i / 255.0f );
+	}
+	/*	rounding in sRGB space, like round( 255 * encode( v ) )	*/
+	for( i = 0; i < 255; ++i )
+	{
+		srgb_threshold[i] = srgb_decode( (i + 0.5f) / 255.0f );
+	}
+	srgb_tables_ready = 1;
+}
+
+static unsigned char linear_to_srgb( float v )
+{
+	/*	binary search for the number of thresholds below v	*/
+	int lo = 0, hi = 255;
+	while( lo < hi )
+	{
+		int mid = (lo + hi) >> 1;
+		if( srgb_threshold[mid] <= v )
+		{
+			lo = mid + 1;
+		} else
+		{
+			hi = mid;
+		}
+	}
+	return (unsigned char)lo;
+}
+
+static unsigned char linear_to_byte( float v )
+{
+	return (unsigned char)(v * 255.0f + 0.5f);
+}
+
+static float sinc( float x )
+{
+	if( fabs( x ) < 1e-6f )
+	{
+		return 1.0f;
+	}
+	x *= 3.14159265358979f;
+	return (float)sin( x ) / x;
+}
+
+static float bessel_i0( float x )
+{
+	/*	power series, converges quickly for the small alphas used	*/
+	float sum = 1.0f, term = 1.0f;
+	int k;
+	for( k = 1; k < 32; ++k )
+	{
+		term *= (x * 0.5f / k) * (x * 0.5f / k);
+		sum += term;
+	}
+	return sum;
+}
+
+static float filter_weight( int filter, float d )
+{
+	float r = MIPMAP_SINC_RADIUS;
+	switch( filter )
+	{
+	case MIPMAP_FILTER_KAISER:
+		if( fabs( d ) >= r )
+		{
+			return 0.0f;
+		}
+		return sinc( d ) *
+			bessel_i0( MIPMAP_KAISER_ALPHA * (float)sqrt( 1.0f - (d/r)*(d/r) ) ) /
+			bessel_i0( MIPMAP_KAISER_ALPHA );
+	case MIPMAP_FILTER_LANCZOS:
+		if( fabs( d ) >= r )
+		{
+			return 0.0f;
+		}
+		return sinc( d ) * sinc( d / r );
+	default:
+		return ((d >= -0.5f) && (d < 0.5f)) ? 1.0f : 0.0f;
+	}
+}
+
+/*	GL_MIRRORED_REPEAT addressing	*/
+static int mirror_index( int i, int n )
+{
+	int period = 2 * n;
+	i %= period;
+	if( i < 0 )
+	{
+		i += period;
+	}
+	return i < n ? i : period - 1 - i;
+}
+
+static void free_axis( filter_axis *axis )
+{
+	free( axis->index );
+	free( axis->weight );
+	axis->index = NULL;
+	axis->weight = NULL;
+}
+
+/*	\return 0 if failed, otherwise 1	*/
+static int build_axis( filter_axis *axis, int src, int dst, int filter, int max_mode )
+{
+	float scale = (float)src / dst;
+	float support = 0.0f;
+	int x, t;
+	if( max_mode )
+	{
+		/*	every source texel touched by the destination texel	*/
+		axis->taps = 1;
+		for( x = 0; x < dst; ++x )
+		{
+			int first = (int)floor( x * scale );
+			int last = (int)ceil( (x + 1) * scale ) - 1;
+			if( last >= src )
+			{
+				last = src - 1;
+			}
+			if( last - first + 1 > axis->taps )
+			{
+				axis->taps = last - first + 1;
+			}
+		}
+	} else
+	{
+		support = (filter == MIPMAP_FILTER_BOX ? 0.5f : MIPMAP_SINC_RADIUS) * scale;
+		axis->taps = (int)ceil( 2.0f * support ) + 1;
+	}
+	axis->index = (int*)malloc( dst * axis->taps * sizeof( int ) );
+	axis->weight = (float*)malloc( dst * axis->taps * sizeof( float ) );
+	if( (NULL == axis->index) || (NULL == axis->weight) )
+	{
+		free_axis( axis );
+		return 0;
+	}
+	for( x = 0; x < dst; ++x )
+	{
+		int *index = axis->index + x * axis->taps;
+		float *weight = axis->weight + x * axis->taps;
+		if( max_mode )
+		{
+			int first = (int)floor( x * scale );
+			int last = (int)ceil( (x + 1) * scale ) - 1;
+			if( last >= src )
+			{
+				last = src - 1;
+			}
+			for( t = 0; t < axis->taps; ++t )
+			{
+				/*	padding repeats the first texel, harmless for a max	*/
+				index[t] = (first + t <= last) ? first + t : first;
+				weight[t] = (first + t <= last) ? 1.0f : 0.0f;
+			}
+		} else
+		{
+			float center = (x + 0.5f) * scale;
+			int first = (int)floor( center - support );
+			float sum = 0.0f;
+			for( t = 0; t < axis->taps; ++t )
+			{
+				float d = (first + t + 0.5f - center) / scale;
+				index[t] = mirror_index( first + t, src );
+				weight[t] = filter_weight( filter, d );
+				sum += weight[t];
+			}
+			for( t = 0; t < axis->taps; ++t )
+			{
+				weight[t] /= sum;
+			}
+		}
+	}
+	return 1;
+}
+
+/********* Filtering *********/
+static void decode_rows( void *arg, int first, int last )
+{
+	decode_job *job = (decode_job*)arg;
+	int n = job->width * job->channels;
+	int y, i;
+	for( y = first; y < last; ++y )
+	{
+		const unsigned char *src = job->src8 + y * n;
+		float *dst = job->dst + y * n;
+		for( i = 0; i < n; ++i )
+		{
+			dst[i] = (i % job->channels < job->srgb_channels) ?
+				srgb_to_linear[src[i]] : src[i] * (1.0f / 255.0f);
+		}
+	}
+}
+
+static void filter_rows( void *arg, int first, int last )
+{
+	mip_job *job = (mip_job*)arg;
+	const filter_axis *h = job->horizontal;
+	const filter_axis *v = job->vertical;
+	int channels = job->channels;
+	int n = job->src_w * channels;
+	float *row = (float*)malloc( n * sizeof( float ) );
+	const float **rows = (const float**)malloc( v->taps * sizeof( float* ) );
+	int x, y, c, k, t;
+	if( (NULL == row) || (NULL == rows) )
+	{
+		/*	leave the rows black rather than crash	*/
+		memset( job->dst + first * job->dst_w * channels, 0,
+			(last - first) * job->dst_w * channels * sizeof( float ) );
+		memset( job->dst8 + first * job->dst_w * channels, 0,
+			(last - first) * job->dst_w * channels );
+		free( row );
+		free( (void*)rows );
+		return;
+	}
+	for( y = first; y < last; ++y )
+	{
+		const float *weight = v->weight + y * v->taps;
+		float *out = job->dst + y * job->dst_w * channels;
+		unsigned char *out8 = job->dst8 + y * job->dst_w * channels;
+		for( t = 0; t < v->taps; ++t )
+		{
+			rows[t] = job->src + v->index[y * v->taps + t] * n;
+		}
+		/*	vertical pass into a single full width row	*/
+		k = 0;
+		#ifdef MIPMAP_SSE2
+		for( ; k + 4 <= n; k += 4 )
+		{
+			__m128 acc = _mm_loadu_ps( rows[0] + k );
+			if( job->max_mode )
+			{
+				for( t = 1; t < v->taps; ++t )
+				{
+					acc = _mm_max_ps( acc, _mm_loadu_ps( rows[t] + k ) );
+				}
+			} else
+			{
+				acc = _mm_mul_ps( acc, _mm_set1_ps( weight[0] ) );
+				for( t = 1; t < v->taps; ++t )
+				{
+					acc = _mm_add_ps( acc,
+						_mm_mul_ps( _mm_loadu_ps( rows[t] + k ), _mm_set1_ps( weight[t] ) ) );
+				}
+			}
+			_mm_storeu_ps( row + k, acc );
+		}
+		#endif
+		for( ; k < n; ++k )
+		{
+			float acc = rows[0][k];
+			if( job->max_mode )
+			{
+				for( t = 1; t < v->taps; ++t )
+				{
+					acc = rows[t][k] > acc ? rows[t][k] : acc;
+				}
+			} else
+			{
+				acc *= weight[0];
+				for( t = 1; t < v->taps; ++t )
+				{
+					acc += rows[t][k] * weight[t];
+				}
+			}
+			row[k] = acc;
+		}
+		/*	horizontal pass, clamped as the sinc lobes can overshoot	*/
+		for( x = 0; x < job->dst_w; ++x )
+		{
+			const int *index = h->index + x * h->taps;
+			const float *hweight = h->weight + x * h->taps;
+			float *texel = out + x * channels;
+			#ifdef MIPMAP_SSE2
+			if( channels == 4 )
+			{
+				__m128 acc = _mm_loadu_ps( row + index[0] * 4 );
+				if( job->max_mode )
+				{
+					for( t = 1; t < h->taps; ++t )
+					{
+						acc = _mm_max_ps( acc, _mm_loadu_ps( row + index[t] * 4 ) );
+					}
+				} else
+				{
+					acc = _mm_mul_ps( acc, _mm_set1_ps( hweight[0] ) );
+					for( t = 1; t < h->taps; ++t )
+					{
+						acc = _mm_add_ps( acc,
+							_mm_mul_ps( _mm_loadu_ps( row + index[t] * 4 ), _mm_set1_ps( hweight[t] ) ) );
+					}
+				}
+				acc = _mm_min_ps( _mm_max_ps( acc, _mm_setzero_ps() ), _mm_set1_ps( 1.0f ) );
+				_mm_storeu_ps( texel, acc );
+			} else
+			#endif
+			for( c = 0; c < channels; ++c )
+			{
+				float acc = row[index[0] * channels + c];
+				if( job->max_mode )
+				{
+					for( t = 1; t < h->taps; ++t )
+					{
+						float s = row[index[t] * channels + c];
+						acc = s > acc ? s : acc;
+					}
+				} else
+				{
+					acc *= hweight[0];
+					for( t = 1; t < h->taps; ++t )
+					{
+						acc += row[index[t] * channels + c] * hweight[t];
+					}
+				}
+				texel[c] = acc < 0.0f ? 0.0f : (acc > 1.0f ? 1.0f : acc);
+			}
+			for( c = 0; c < channels; ++c )
+			{
+				out8[x * channels + c] = (c < job->srgb_channels) ?
+					linear_to_srgb( texel[c] ) : linear_to_byte( texel[c] );
+			}
+		}
+	}
+	free( row );
+	free( (void*)rows );
+}
+
+/********* Public Functions *********/
+int
+	mipmap_chain_levels
+	(
+		int width, int height
+	)
+{
+	int levels = 1;
+	while( (width > 1) || (height > 1) )
+	{
+		width >>= 1;
+		height >>= 1;
+		++levels;
+	}
+	return levels;
+}
+
+unsigned char*
+	build_mipmap_chain
+	(
+		const unsigned char *const orig,
+		int width, int height, int channels,
+		int filter, int flags,
+		int *levels, int *size
+	)
+{
+	unsigned char *chain, *level8;
+	float *level, *next;
+	decode_job decode;
+	int w = width, h = height;
+	int i;
+	int max_mode = (flags & MIPMAP_MAX) != 0;
+	int srgb_channels = 0;
+	/*	error check	*/
+	*levels = 0;
+	*size = 0;
+	if( (width < 1) || (height < 1) ||
+		(channels < 1) || (channels > 4) ||
+		(NULL == orig) )
+	{
+		return NULL;
+	}
+	if( (flags & MIPMAP_SRGB) && !max_mode )
+	{
+		/*	leave alpha (the 2nd or 4th channel) linear	*/
+		srgb_channels = channels >= 3 ? 3 : 1;
+	}
+	build_srgb_tables();
+	/*	room for every level	*/
+	*levels = mipmap_chain_levels( width, height );
+	for( i = 0; i < *levels; ++i )
+	{
+		int lw = width >> i, lh = height >> i;
+		*size += (lw > 0 ? lw : 1) * (lh > 0 ? lh : 1) * channels;
+	}
+	chain = (unsigned char*)malloc( *size );
+	level = (float*)malloc( width * height * channels * sizeof( float ) );
+	if( (NULL == chain) || (NULL == level) )
+	{
+		free( chain );
+		free( level );
+		*levels = 0;
+		*size = 0;
+		return NULL;
+	}
+	memcpy( chain, orig, width * height * channels );
+	level8 = chain + width * height * channels;
+	/*	level 0 to linear floats	*/
+	decode.src8 = orig;
+	decode.dst = level;
+	decode.width = width;
+	decode.channels = channels;
+	decode.srgb_channels = srgb_channels;
+	parallel_for( height, MIPMAP_ROWS_PER_THREAD, decode_rows, &decode );
+	/*	and filter each level from the previous one	*/
+	for( i = 1; i < *levels; ++i )
+	{
+		filter_axis horizontal, vertical;
+		mip_job job;
+		int nw = (w >> 1) > 0 ? (w >> 1) : 1;
+		int nh = (h >> 1) > 0 ? (h >> 1) : 1;
+		next = (float*)malloc( nw * nh * channels * sizeof( float ) );
+		horizontal.index = vertical.index = NULL;
+		horizontal.weight = vertical.weight = NULL;
+		if( (NULL == next) ||
+			!build_axis( &horizontal, w, nw, filter, max_mode ) ||
+			!build_axis( &vertical, h, nh, filter, max_mode ) )
+		{
+			free_axis( &horizontal );
+			free( next );
+			free( level );
+			free( chain );
+			*levels = 0;
+			*size = 0;
+			return NULL;
+		}
+		job.src = level;
+		job.src_w = w;
+		job.channels = channels;
+		job.dst = next;
+		job.dst8 = level8;
+		job.dst_w = nw;
+		job.horizontal = &horizontal;
+		job.vertical = &vertical;
+		job.max_mode = max_mode;
+		job.srgb_channels = srgb_channels;
+		parallel_for( nh, MIPMAP_ROWS_PER_THREAD, filter_rows, &job );
+		free_axis( &horizontal );
+		free_axis( &vertical );
+		free( level );
+		level = next;
+		level8 += nw * nh * channels;
+		w = nw;
+		h = nh;
+	}
+	free( level );
+	return chain;
+}
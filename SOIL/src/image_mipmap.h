@@ -0,0 +1,74 @@
+/*
+    MIPmap chain generation with selectable filters
+
+    MIT license
+*/
+
+#ifndef HEADER_IMAGE_MIPMAP
+#define HEADER_IMAGE_MIPMAP
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+	The filters a MIPmap chain can be built with.
+	Box averages the texels under each new texel (like mipmap_image),
+	Kaiser and Lanczos are windowed sincs that keep the levels sharper.
+**/
+enum
+{
+	MIPMAP_FILTER_BOX = 0,
+	MIPMAP_FILTER_KAISER = 1,
+	MIPMAP_FILTER_LANCZOS = 2
+};
+
+/**
+	MIPmap generation flags.
+	MIPMAP_SRGB : the color channels are sRGB encoded, filter them in
+		linear space (alpha, if any, is always linear)
+	MIPMAP_MAX : every texel keeps the maximum of the texels it covers
+		instead of a filtered average, for height maps whose coarser
+		levels must never sink below the full resolution surface
+		(the filter and MIPMAP_SRGB are ignored)
+**/
+enum
+{
+	MIPMAP_SRGB = 1,
+	MIPMAP_MAX = 2
+};
+
+/**
+	The number of levels in a full MIPmap chain, down to 1x1.
+**/
+int
+	mipmap_chain_levels
+	(
+		int width, int height
+	);
+
+/**
+	Builds the full MIPmap chain of an image.  Level 0 is a copy of the
+	image, every other level is half the size of the previous one
+	(rounded down, at least 1) and is filtered from the previous level
+	kept at float precision.  The levels are packed one after another.
+	Image edges are mirrored, like GL_MIRRORED_REPEAT.  The rows of each
+	level are filtered on several threads (see image_threads.h).
+	\param levels receives the number of levels
+	\param size receives the size of the chain in bytes
+	\return the chain (release it with free()), or NULL if failed
+**/
+unsigned char*
+	build_mipmap_chain
+	(
+		const unsigned char *const orig,
+		int width, int height, int channels,
+		int filter, int flags,
+		int *levels, int *size
+	);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HEADER_IMAGE_MIPMAP	*/
@@ -0,0 +1,145 @@
+/*
+    Simple parallel-for used by the image helper and DXT code
+
+    MIT license
+*/
+
+#include "image_threads.h"
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#else
+	#include <pthread.h>
+	#include <unistd.h>
+#endif
+
+#define MAX_IMAGE_THREADS	64
+
+static int image_thread_count = 0;
+
+typedef struct
+{
+	parallel_job job;
+	void *arg;
+	int first, last;
+}
+parallel_range;
+
+#ifdef _WIN32
+static DWORD WINAPI run_range( LPVOID p )
+{
+	parallel_range *range = (parallel_range*)p;
+	range->job( range->arg, range->first, range->last );
+	return 0;
+}
+#else
+static void *run_range( void *p )
+{
+	parallel_range *range = (parallel_range*)p;
+	range->job( range->arg, range->first, range->last );
+	return NULL;
+}
+#endif
+
+int
+	get_image_thread_count( void )
+{
+	if( image_thread_count < 1 )
+	{
+		/*	ask the OS how many processors we have	*/
+		#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo( &info );
+		image_thread_count = (int)info.dwNumberOfProcessors;
+		#else
+		image_thread_count = (int)sysconf( _SC_NPROCESSORS_ONLN );
+		#endif
+		if( image_thread_count < 1 )
+		{
+			image_thread_count = 1;
+		}
+	}
+	return image_thread_count;
+}
+
+void
+	set_image_thread_count( int threads )
+{
+	image_thread_count = threads;
+}
+
+void
+	parallel_for
+	(
+		int count, int min_per_thread,
+		parallel_job job, void *arg
+	)
+{
+	parallel_range ranges[MAX_IMAGE_THREADS];
+	#ifdef _WIN32
+	HANDLE handles[MAX_IMAGE_THREADS];
+	#else
+	pthread_t handles[MAX_IMAGE_THREADS];
+	#endif
+	int started[MAX_IMAGE_THREADS];
+	int threads = get_image_thread_count();
+	int i;
+	/*	how many threads are worth it?	*/
+	if( min_per_thread < 1 )
+	{
+		min_per_thread = 1;
+	}
+	if( threads > count / min_per_thread )
+	{
+		threads = count / min_per_thread;
+	}
+	if( threads > MAX_IMAGE_THREADS )
+	{
+		threads = MAX_IMAGE_THREADS;
+	}
+	if( threads < 2 )
+	{
+		if( count > 0 )
+		{
+			job( arg, 0, count );
+		}
+		return;
+	}
+	/*	hand out the ranges, the calling thread takes the first one	*/
+	for( i = 0; i < threads; ++i )
+	{
+		ranges[i].job = job;
+		ranges[i].arg = arg;
+		ranges[i].first = (int)((long long)count * i / threads);
+		ranges[i].last = (int)((long long)count * (i + 1) / threads);
+	}
+	for( i = 1; i < threads; ++i )
+	{
+		#ifdef _WIN32
+		handles[i] = CreateThread( NULL, 0, run_range, &ranges[i], 0, NULL );
+		started[i] = (handles[i] != NULL);
+		#else
+		started[i] = (pthread_create( &handles[i], NULL, run_range, &ranges[i] ) == 0);
+		#endif
+		if( !started[i] )
+		{
+			/*	could not get a thread, do it ourselves	*/
+			run_range( &ranges[i] );
+		}
+	}
+	run_range( &ranges[0] );
+	/*	wait for everybody	*/
+	for( i = 1; i < threads; ++i )
+	{
+		if( started[i] )
+		{
+			#ifdef _WIN32
+			WaitForSingleObject( handles[i], INFINITE );
+			CloseHandle( handles[i] );
+			#else
+			pthread_join( handles[i], NULL );
+			#endif
+		}
+	}
+}
@@ -0,0 +1,47 @@
+/*
+    Simple parallel-for used by the image helper and DXT code
+
+    MIT license
+*/
+
+#ifndef HEADER_IMAGE_THREADS
+#define HEADER_IMAGE_THREADS
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+	A piece of work over the items [first, last).
+**/
+typedef void (*parallel_job)( void *arg, int first, int last );
+
+/**
+	The number of worker threads parallel_for will use at most.
+	Defaults to the number of online processors, set it with
+	set_image_thread_count (1 turns threading off).
+**/
+int
+	get_image_thread_count( void );
+
+void
+	set_image_thread_count( int threads );
+
+/**
+	Splits the items [0, count) into contiguous ranges and runs job on
+	each of them, using the calling thread plus worker threads.
+	Ranges are never smaller than min_per_thread items, so small jobs
+	run on the calling thread only.  Returns once all ranges are done.
+**/
+void
+	parallel_for
+	(
+		int count, int min_per_thread,
+		parallel_job job, void *arg
+	);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HEADER_IMAGE_THREADS	*/
@@ -94,9 +94,21 @@ typedef   signed short  int16;
 typedef unsigned int   uint32;
 typedef   signed int    int32;
 typedef unsigned int   uint;
+#ifdef _MSC_VER
+typedef unsigned __int64 uint64;
+#else
+typedef unsigned long long uint64;
+#endif
 
 // should produce compiler error if size is wrong
 typedef unsigned char validate_uint32[sizeof(uint32)==4];
+typedef unsigned char validate_uint64[sizeof(uint64)==8];
+
+// SSE2 png unfiltering (define STBI_NO_SIMD to remove code)
+#if !defined(STBI_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define STBI_SSE2
+#include <emmintrin.h>
+#endif
 
 #if defined(STBI_NO_STDIO) && !defined(STBI_NO_WRITE)
 #define STBI_NO_WRITE
@@ -114,8 +126,18 @@ typedef unsigned char validate_uint32[sizeof(uint32)==4];
 // Generic API that works on all image types
 //
 
-// this is not threadsafe
-static char *failure_reason;
+// one per thread, so decodes running concurrently (TextureLoader) each
+// report their own failure
+#if defined(_MSC_VER)
+  #define STBI_THREAD_LOCAL __declspec(thread)
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+  #define STBI_THREAD_LOCAL _Thread_local
+#elif defined(__GNUC__)
+  #define STBI_THREAD_LOCAL __thread
+#else
+  #define STBI_THREAD_LOCAL
+#endif
+static STBI_THREAD_LOCAL char *failure_reason;
 
 char *stbi_failure_reason(void)
 {
@@ -1601,22 +1623,26 @@ extern int      stbi_jpeg_info_from_memory(stbi_uc const *buffer, int len, int *
 //      - all input must be provided in an upfront buffer
 //      - all output is written to a single output buffer (can malloc/realloc)
 //    performance
-//      - fast huffman
+//      - fast huffman (two-level table lookup)
+//      - 64-bit bit buffer refilled a word at a time
+//      - word-at-a-time match copies
 
-// fast-way is faster to check than jpeg huffman, but slow way is slower
 #define ZFAST_BITS  9 // accelerate all cases in default tables
 #define ZFAST_MASK  ((1 << ZFAST_BITS) - 1)
+#define ZSUB_SIZE   2048 // room for the second-level tables of any valid code
 
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
+//
+// codes of up to ZFAST_BITS resolve directly in fast[], longer ones go
+// through a second-level table in sub[] indexed by the bits that follow.
+// entries are (value << 4) | length, zero marks an invalid code; a fast[]
+// entry with the top bit set is a link 0x8000 | (bits << 11) | offset
+// to a second-level table of 1 << bits entries
 typedef struct
 {
    uint16 fast[1 << ZFAST_BITS];
-   uint16 firstcode[16];
-   int maxcode[17];
-   uint16 firstsymbol[16];
-   uint8  size[288];
-   uint16 value[288];
+   uint16 sub[ZSUB_SIZE];
 } zhuffman;
 
 __forceinline static int bitreverse16(int n)
@@ -1638,12 +1664,14 @@ __forceinline static int bit_reverse(int v, int bits)
 
 static int zbuild_huffman(zhuffman *z, uint8 *sizelist, int num)
 {
-   int i,k=0;
-   int code, next_code[16], sizes[17];
+   int i,j;
+   int code, next_code[16], long_code[16], sizes[17];
+   int sub_bits[1 << ZFAST_BITS];
+   int used = 0;
 
    // DEFLATE spec for generating codes
    memset(sizes, 0, sizeof(sizes));
-   memset(z->fast, 255, sizeof(z->fast));
+   memset(z->fast, 0, sizeof(z->fast));
    for (i=0; i < num; ++i)
       ++sizes[sizelist[i]];
    sizes[0] = 0;
@@ -1652,28 +1680,48 @@ static int zbuild_huffman(zhuffman *z, uint8 *sizelist, int num)
    code = 0;
    for (i=1; i < 16; ++i) {
       next_code[i] = code;
-      z->firstcode[i] = (uint16) code;
-      z->firstsymbol[i] = (uint16) k;
       code = (code + sizes[i]);
       if (sizes[i])
          if (code-1 >= (1 << i)) return e("bad codelengths","Corrupt JPEG");
-      z->maxcode[i] = code << (16-i); // preshift for inner loop
       code <<= 1;
-      k += sizes[i];
    }
-   z->maxcode[16] = 0x10000; // sentinel
+
+   // size the second-level table of every prefix by its longest code
+   memset(sub_bits, 0, sizeof(sub_bits));
+   memcpy(long_code, next_code, sizeof(next_code));
+   for (i=0; i < num; ++i) {
+      int s = sizelist[i];
+      if (s > ZFAST_BITS) {
+         int k = bit_reverse(long_code[s]++, s) & ZFAST_MASK;
+         if (s - ZFAST_BITS > sub_bits[k])
+            sub_bits[k] = s - ZFAST_BITS;
+      }
+   }
+   for (i=0; i < (1 << ZFAST_BITS); ++i) {
+      if (sub_bits[i]) {
+         if (used + (1 << sub_bits[i]) > ZSUB_SIZE) return e("bad codelengths","Corrupt PNG");
+         z->fast[i] = (uint16) (0x8000 | (sub_bits[i] << 11) | used);
+         memset(z->sub + used, 0, sizeof(uint16) << sub_bits[i]);
+         used += 1 << sub_bits[i];
+      }
+   }
+
+   // fill in both levels, replicating each code over the bits it ignores
    for (i=0; i < num; ++i) {
       int s = sizelist[i];
       if (s) {
-         int c = next_code[s] - z->firstcode[s] + z->firstsymbol[s];
-         z->size[c] = (uint8)s;
-         z->value[c] = (uint16)i;
+         int k = bit_reverse(next_code[s],s);
+         uint16 entry = (uint16) ((i << 4) | s);
          if (s <= ZFAST_BITS) {
-            int k = bit_reverse(next_code[s],s);
             while (k < (1 << ZFAST_BITS)) {
-               z->fast[k] = (uint16) c;
+               z->fast[k] = entry;
                k += (1 << s);
             }
+         } else {
+            int link = z->fast[k & ZFAST_MASK];
+            uint16 *table = z->sub + (link & 0x7ff);
+            for (j = k >> ZFAST_BITS; j < (1 << ((link >> 11) & 15)); j += 1 << (s - ZFAST_BITS))
+               table[j] = entry;
          }
          ++next_code[s];
       }
@@ -1691,7 +1739,7 @@ typedef struct
 {
    uint8 *zbuffer, *zbuffer_end;
    int num_bits;
-   uint32 code_buffer;
+   uint64 code_buffer;
 
    char *zout;
    char *zout_start;
@@ -1707,20 +1755,38 @@ __forceinline static int zget8(zbuf *z)
    return *z->zbuffer++;
 }
 
+__forceinline static uint64 zget64le(const uint8 *p)
+{
+   return ((uint64) p[0]      ) | ((uint64) p[1] <<  8) |
+          ((uint64) p[2] << 16) | ((uint64) p[3] << 24) |
+          ((uint64) p[4] << 32) | ((uint64) p[5] << 40) |
+          ((uint64) p[6] << 48) | ((uint64) p[7] << 56);
+}
+
 static void fill_bits(zbuf *z)
 {
+   if (z->zbuffer_end - z->zbuffer >= 8) {
+      // take as many whole bytes as fit in the buffer with one load
+      int n = (63 - z->num_bits) >> 3;
+      uint64 word = zget64le(z->zbuffer) & ((((uint64) 1) << (n << 3)) - 1);
+      z->code_buffer |= word << z->num_bits;
+      z->zbuffer += n;
+      z->num_bits += n << 3;
+      return;
+   }
+   // near the end, go byte by byte (zget8 pads with zeros)
    do {
-      assert(z->code_buffer < (1U << z->num_bits));
-      z->code_buffer |= zget8(z) << z->num_bits;
+      assert(z->code_buffer < (((uint64) 1) << z->num_bits));
+      z->code_buffer |= (uint64) zget8(z) << z->num_bits;
       z->num_bits += 8;
-   } while (z->num_bits <= 24);
+   } while (z->num_bits <= 48);
 }
 
 __forceinline static unsigned int zreceive(zbuf *z, int n)
 {
    unsigned int k;
    if (z->num_bits < n) fill_bits(z);
-   k = z->code_buffer & ((1 << n) - 1);
+   k = (unsigned int) z->code_buffer & ((1 << n) - 1);
    z->code_buffer >>= n;
    z->num_bits -= n;
    return k;
@@ -1728,29 +1794,19 @@ __forceinline static unsigned int zreceive(zbuf *z, int n)
 
 __forceinline static int zhuffman_decode(zbuf *a, zhuffman *z)
 {
-   int b,s,k;
+   int b,s;
    if (a->num_bits < 16) fill_bits(a);
    b = z->fast[a->code_buffer & ZFAST_MASK];
-   if (b < 0xffff) {
-      s = z->size[b];
-      a->code_buffer >>= s;
-      a->num_bits -= s;
-      return z->value[b];
-   }
-
-   // not resolved by fast table, so compute it the slow way
-   // use jpeg approach, which requires MSbits at top
-   k = bit_reverse(a->code_buffer, 16);
-   for (s=ZFAST_BITS+1; ; ++s)
-      if (k < z->maxcode[s])
-         break;
-   if (s == 16) return -1; // invalid code!
-   // code size is s, so:
-   b = (k >> (16-s)) - z->firstcode[s] + z->firstsymbol[s];
-   assert(z->size[b] == s);
+   if (b & 0x8000) {
+      // long code, look up the remaining bits in the second level
+      int bits = (b >> 11) & 15;
+      b = z->sub[(b & 0x7ff) + ((a->code_buffer >> ZFAST_BITS) & ((1 << bits) - 1))];
+   }
+   s = b & 15;
+   if (s == 0) return -1; // invalid code!
    a->code_buffer >>= s;
    a->num_bits -= s;
-   return z->value[b];
+   return b >> 4;
 }
 
 static int expand(zbuf *z, int n)  // need to make room for n bytes
@@ -1806,8 +1862,19 @@ static int parse_huffman_block(zbuf *a)
          if (a->zout - a->zout_start < dist) return e("bad dist","Corrupt PNG");
          if (a->zout + len > a->zout_end) if (!expand(a, len)) return 0;
          p = (uint8 *) (a->zout - dist);
-         while (len--)
-            *a->zout++ = *p++;
+         if (dist == 1) {
+            // run of a single byte
+            memset(a->zout, *p, len);
+            a->zout += len;
+         } else {
+            // a word apart or more, the source never overlaps a copied word
+            if (dist >= 8) {
+               for (; len >= 8; len -= 8, p += 8, a->zout += 8)
+                  memcpy(a->zout, p, 8);
+            }
+            while (len--)
+               *a->zout++ = *p++;
+         }
       }
    }
 }
@@ -1815,7 +1882,7 @@ static int parse_huffman_block(zbuf *a)
 static int compute_huffman_codes(zbuf *a)
 {
    static uint8 length_dezigzag[19] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
-   static zhuffman z_codelength; // static just to save stack space
+   zhuffman z_codelength; // on the stack so concurrent decodes don't share it
    uint8 lencodes[286+32+137];//padding for maximum single op
    uint8 codelength_sizes[19];
    int i,n;
@@ -1860,11 +1927,12 @@ static int compute_huffman_codes(zbuf *a)
 
 static int parse_uncompressed_block(zbuf *a)
 {
-   uint8 header[4];
-   int len,nlen,k;
+   uint8 header[8];
+   int len,nlen,k,buffered;
    if (a->num_bits & 7)
       zreceive(a, a->num_bits & 7); // discard
-   // drain the bit-packed data into header
+   // drain the bit-packed data into header; the word refill can have
+   // buffered up to 7 bytes, anything past the header is block data
    k = 0;
    while (a->num_bits > 0) {
       header[k++] = (uint8) (a->code_buffer & 255); // wtf this warns?
@@ -1878,11 +1946,21 @@ static int parse_uncompressed_block(zbuf *a)
    len  = header[1] * 256 + header[0];
    nlen = header[3] * 256 + header[2];
    if (nlen != (len ^ 0xffff)) return e("zlib corrupt","Corrupt PNG");
-   if (a->zbuffer + len > a->zbuffer_end) return e("read past buffer","Corrupt PNG");
+   buffered = k - 4;
+   if (buffered > len) {
+      // tiny block, give the bytes following it back to the bit buffer
+      for (--k; k >= 4 + len; --k) {
+         a->code_buffer = (a->code_buffer << 8) | header[k];
+         a->num_bits += 8;
+      }
+      buffered = len;
+   }
+   if (a->zbuffer + (len - buffered) > a->zbuffer_end) return e("read past buffer","Corrupt PNG");
    if (a->zout + len > a->zout_end)
       if (!expand(a, len)) return 0;
-   memcpy(a->zout, a->zbuffer, len);
-   a->zbuffer += len;
+   memcpy(a->zout, header + 4, buffered);
+   memcpy(a->zout + buffered, a->zbuffer, len - buffered);
+   a->zbuffer += len - buffered;
    a->zout += len;
    return 1;
 }
@@ -1900,18 +1978,23 @@ static int parse_zlib_header(zbuf *a)
    return 1;
 }
 
-// @TODO: should statically initialize these for optimal thread safety
-static uint8 default_length[288], default_distance[32];
-static void init_defaults(void)
+// statically initialized so concurrent decodes never race on them
+static uint8 default_length[288] =
 {
-   int i;   // use <= to match clearly with spec
-   for (i=0; i <= 143; ++i)     default_length[i]   = 8;
-   for (   ; i <= 255; ++i)     default_length[i]   = 9;
-   for (   ; i <= 279; ++i)     default_length[i]   = 7;
-   for (   ; i <= 287; ++i)     default_length[i]   = 8;
-
-   for (i=0; i <=  31; ++i)     default_distance[i] = 5;
-}
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,
+   8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+   9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+   9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+   9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,9,
+   7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,7,8,8,8,8,8,8,8,8
+};
+static uint8 default_distance[32] =
+{
+   5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5,5
+};
 
 static int parse_zlib(zbuf *a, int parse_header)
 {
@@ -1930,7 +2013,6 @@ static int parse_zlib(zbuf *a, int parse_header)
       } else {
          if (type == 1) {
             // use fixed code lengths
-            if (!default_distance[31]) init_defaults();
             if (!zbuild_huffman(&a->z_length  , default_length  , 288)) return 0;
             if (!zbuild_huffman(&a->z_distance, default_distance,  32)) return 0;
          } else {
@@ -2075,6 +2157,129 @@ static int paeth(int a, int b, int c)
    return c;
 }
 
+#ifdef STBI_SSE2
+// unfilter a row of 3 or 4 byte pixels, one pixel per SSE2 register;
+// the pixels depend on their left neighbour, so all channels of a pixel
+// are processed together (same approach as libpng's SSE2 filters)
+__forceinline static __m128i load_pixel(uint8 const *p, int bpp)
+{
+   int v = 0;
+   memcpy(&v, p, bpp);
+   return _mm_cvtsi32_si128(v);
+}
+
+__forceinline static void store_pixel(uint8 *p, __m128i x, int bpp)
+{
+   int v = _mm_cvtsi128_si32(x);
+   memcpy(p, &v, bpp);
+}
+
+static void unfilter_sub_sse2(uint8 *cur, uint8 const *raw, int n, int bpp)
+{
+   __m128i a = _mm_setzero_si128();
+   int i;
+   for (i=0; i < n; i += bpp) {
+      a = _mm_add_epi8(a, load_pixel(raw+i, bpp));
+      store_pixel(cur+i, a, bpp);
+   }
+}
+
+static void unfilter_avg_sse2(uint8 *cur, uint8 const *prior, uint8 const *raw, int n, int bpp)
+{
+   const __m128i one = _mm_set1_epi8(1);
+   __m128i a = _mm_setzero_si128();
+   int i;
+   for (i=0; i < n; i += bpp) {
+      __m128i b = load_pixel(prior+i, bpp);
+      // _mm_avg_epu8 rounds up, the filter rounds down
+      __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+      a = _mm_add_epi8(load_pixel(raw+i, bpp), avg);
+      store_pixel(cur+i, a, bpp);
+   }
+}
+
+__forceinline static __m128i abs_epi16(__m128i x)
+{
+   return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+__forceinline static __m128i select_epi16(__m128i mask, __m128i x, __m128i y)
+{
+   return _mm_or_si128(_mm_and_si128(mask, x), _mm_andnot_si128(mask, y));
+}
+
+static void unfilter_paeth_sse2(uint8 *cur, uint8 const *prior, uint8 const *raw, int n, int bpp)
+{
+   const __m128i zero = _mm_setzero_si128();
+   __m128i a = zero, c = zero;
+   int i;
+   for (i=0; i < n; i += bpp) {
+      __m128i b = _mm_unpacklo_epi8(load_pixel(prior+i, bpp), zero);
+      __m128i pa = _mm_sub_epi16(b, c);   // p - a
+      __m128i pb = _mm_sub_epi16(a, c);   // p - b
+      __m128i pc = _mm_add_epi16(pa, pb); // p - c
+      __m128i smallest, nearest;
+      pa = abs_epi16(pa);
+      pb = abs_epi16(pb);
+      pc = abs_epi16(pc);
+      smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+      // ties prefer a, then b, like paeth()
+      nearest = select_epi16(_mm_cmpeq_epi16(smallest, pb), b, c);
+      nearest = select_epi16(_mm_cmpeq_epi16(smallest, pa), a, nearest);
+      a = _mm_add_epi8(load_pixel(raw+i, bpp), _mm_packus_epi16(nearest, nearest));
+      store_pixel(cur+i, a, bpp);
+      a = _mm_unpacklo_epi8(a, zero);
+      c = b;
+   }
+}
+#endif
+
+// unfilter a whole row of n bytes; on the first row prior is all zeros,
+// which turns up, avg and paeth into their first row variants
+static void unfilter_row(int filter, uint8 *cur, uint8 const *prior, uint8 const *raw, int n, int bpp)
+{
+   int i = 0;
+   #ifdef STBI_SSE2
+   int vector = (bpp == 3 || bpp == 4);
+   #endif
+   switch (filter) {
+      case F_none:
+         memcpy(cur, raw, n);
+         break;
+      case F_sub:
+         #ifdef STBI_SSE2
+         if (vector) { unfilter_sub_sse2(cur, raw, n, bpp); break; }
+         #endif
+         for (; i < bpp; ++i) cur[i] = raw[i];
+         for (; i < n; ++i) cur[i] = raw[i] + cur[i-bpp];
+         break;
+      case F_up:
+         #ifdef STBI_SSE2
+         for (; i+16 <= n; i += 16) {
+            __m128i x = _mm_loadu_si128((__m128i const *) (raw+i));
+            __m128i y = _mm_loadu_si128((__m128i const *) (prior+i));
+            _mm_storeu_si128((__m128i *) (cur+i), _mm_add_epi8(x, y));
+         }
+         #endif
+         for (; i < n; ++i) cur[i] = raw[i] + prior[i];
+         break;
+      case F_avg:
+         #ifdef STBI_SSE2
+         if (vector) { unfilter_avg_sse2(cur, prior, raw, n, bpp); break; }
+         #endif
+         for (; i < bpp; ++i) cur[i] = raw[i] + (prior[i] >> 1);
+         for (; i < n; ++i) cur[i] = raw[i] + ((prior[i] + cur[i-bpp]) >> 1);
+         break;
+      case F_paeth:
+         #ifdef STBI_SSE2
+         if (vector) { unfilter_paeth_sse2(cur, prior, raw, n, bpp); break; }
+         #endif
+         for (; i < bpp; ++i) cur[i] = raw[i] + prior[i];
+         for (; i < n; ++i) cur[i] = (uint8) (raw[i] + paeth(cur[i-bpp], prior[i], prior[i-bpp]));
+         break;
+   }
+}
+
 // create the png data from post-deflated data
 static int create_png_image(png *a, uint8 *raw, uint32 raw_len, int out_n)
 {
@@ -2082,15 +2287,26 @@ static int create_png_image(png *a, uint8 *raw, uint32 raw_len, int out_n)
    uint32 i,j,stride = s->img_x*out_n;
    int k;
    int img_n = s->img_n; // copy it into a local for later
+   uint8 *zeros = NULL;
    assert(out_n == s->img_n || out_n == s->img_n+1);
    a->out = (uint8 *) malloc(s->img_x * s->img_y * out_n);
    if (!a->out) return e("outofmem", "Out of memory");
    if (raw_len != (img_n * s->img_x + 1) * s->img_y) return e("not enough pixels","Corrupt PNG");
+   if (img_n == out_n) {
+      // the row above the first one, see unfilter_row
+      zeros = (uint8 *) calloc(stride, 1);
+      if (!zeros) return e("outofmem", "Out of memory");
+   }
    for (j=0; j < s->img_y; ++j) {
       uint8 *cur = a->out + stride*j;
       uint8 *prior = cur - stride;
       int filter = *raw++;
-      if (filter > 4) return e("invalid filter","Corrupt PNG");
+      if (filter > 4) { free(zeros); return e("invalid filter","Corrupt PNG"); }
+      if (img_n == out_n) {
+         unfilter_row(filter, cur, j ? prior : zeros, raw, stride, img_n);
+         raw += stride;
+         continue;
+      }
       // if first row, use special filter that doesn't sample previous row
       if (j == 0) filter = first_row_filter[filter];
       // handle first pixel explicitly
@@ -2110,22 +2326,7 @@ static int create_png_image(png *a, uint8 *raw, uint32 raw_len, int out_n)
       cur += out_n;
       prior += out_n;
       // this is a little gross, so that we don't switch per-pixel or per-component
-      if (img_n == out_n) {
-         #define CASE(f) \
-             case f:     \
-                for (i=s->img_x-1; i >= 1; --i, raw+=img_n,cur+=img_n,prior+=img_n) \
-                   for (k=0; k < img_n; ++k)
-         switch(filter) {
-            CASE(F_none)  cur[k] = raw[k]; break;
-            CASE(F_sub)   cur[k] = raw[k] + cur[k-img_n]; break;
-            CASE(F_up)    cur[k] = raw[k] + prior[k]; break;
-            CASE(F_avg)   cur[k] = raw[k] + ((prior[k] + cur[k-img_n])>>1); break;
-            CASE(F_paeth)  cur[k] = (uint8) (raw[k] + paeth(cur[k-img_n],prior[k],prior[k-img_n])); break;
-            CASE(F_avg_first)    cur[k] = raw[k] + (cur[k-img_n] >> 1); break;
-            CASE(F_paeth_first)  cur[k] = (uint8) (raw[k] + paeth(cur[k-img_n],0,0)); break;
-         }
-         #undef CASE
-      } else {
+      {
          assert(img_n+1 == out_n);
          #define CASE(f) \
              case f:     \
@@ -2143,6 +2344,7 @@ static int create_png_image(png *a, uint8 *raw, uint32 raw_len, int out_n)
          #undef CASE
       }
    }
+   free(zeros);
    return 1;
 }
 
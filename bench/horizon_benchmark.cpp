@@ -0,0 +1,105 @@
+/*
+	HorizonCuller benchmark
+
+	Culls a synthetic hilly terrain of 256x256 patches of 64 quads, the
+	size of a 16k heightmap, from a few cameras just above the ground and
+	reports the time per cull() and the patches it hid.  Nothing is left
+	to the frustum, every cull walks the whole map.  First it checks that
+	a ridge hides the low ground behind it and nothing in front of it.
+
+	usage: horizon_benchmark [iterations]
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "horizon_culler.h"
+
+static const int Patches = 256;
+static const float Quads = 64.0f;
+
+static bool everything(const glm::vec3 &, const glm::vec3 &) {
+  return true;
+}
+
+/* Flat ground with a ridge across the map, patch rows 128 to 131 */
+static bool ridge_hides_behind() {
+  std::vector<float> minHeights(Patches * Patches, 0.0f), maxHeights(Patches * Patches, 10.0f);
+  for (int y = 128; y < 132; y++) {
+    for (int x = 0; x < Patches; x++) {
+      minHeights[y * Patches + x] = 500.0f;
+      maxHeights[y * Patches + x] = 520.0f;
+    }
+  }
+
+  HorizonCuller culler { minHeights, maxHeights, Patches, Quads };
+  culler.cull({ 128.5f * Quads, 100.5f * Quads, 100.0f }, everything);
+
+  for (int y = 0; y < Patches; y++) {
+    for (int x = 112; x < 144; x++) {
+      /* Right behind the ridge the ground is far under its top */
+      bool behind = y > 133 && y < 200;
+      bool inFront = y <= 128;
+
+      if ((behind && !culler.hidden(y * Patches + x)) || (inFront && culler.hidden(y * Patches + x))) {
+        printf("ridge: patch %d %d %s\n", x, y, behind ? "not hidden" : "hidden");
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+int main(int argc, char **argv) {
+  int iterations = 20;
+  if (argc > 1) {
+    iterations = std::max(atoi(argv[1]), 1);
+  }
+
+  if (!ridge_hides_behind()) {
+    return EXIT_FAILURE;
+  }
+
+  /* Hills of several scales, every patch 80 units high */
+  std::vector<float> minHeights(Patches * Patches), maxHeights(Patches * Patches);
+  for (int y = 0; y < Patches; y++) {
+    for (int x = 0; x < Patches; x++) {
+      float h = 300.0f + 250.0f * std::sin(x * 0.11f) * std::cos(y * 0.07f) + 120.0f * std::sin(x * 0.37f + y * 0.23f);
+      minHeights[y * Patches + x] = h - 40.0f;
+      maxHeights[y * Patches + x] = h + 40.0f;
+    }
+  }
+
+  HorizonCuller culler { minHeights, maxHeights, Patches, Quads };
+
+  /* Map corner, map center and two points between, in patches */
+  const glm::vec2 cameras[] = { { 4.5f, 4.5f }, { 128.5f, 128.5f }, { 60.3f, 190.7f }, { 200.2f, 31.6f } };
+
+  for (const glm::vec2 &p : cameras) {
+    int i = (int) p.y * Patches + (int) p.x;
+    glm::vec3 camera { p.x * Quads, p.y * Quads, maxHeights[i] + 20.0f };
+
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < iterations; n++) {
+      culler.cull(camera, everything);
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    int hidden = 0;
+    for (int n = 0; n < Patches * Patches; n++) {
+      hidden += culler.hidden(n);
+    }
+
+    printf("camera %6.1f %6.1f  %8.3f ms per cull  %5d of %d patches hidden\n",
+           p.x, p.y, ms / iterations, hidden, Patches * Patches);
+  }
+
+  return EXIT_SUCCESS;
+}
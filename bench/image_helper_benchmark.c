@@ -0,0 +1,175 @@
+/*
+	image_helper benchmark
+
+	Runs the kernels SOIL applies while loading (up_scale_image for
+	SOIL_FLAG_POWER_OF_TWO, scale_image_RGB_to_NTSC_safe and the YCoCg
+	conversions) with the scalar reference and with the SIMD version,
+	reports the timings of both and checks that they produced exactly
+	the same bytes.  Every image is run as loaded and as RGBA.
+
+	usage: image_helper_benchmark [iterations] [image ...]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stb_image_aug.h"
+#include "image_helper.h"
+
+/*	from image_helper_reference.c	*/
+int ref_up_scale_image( const unsigned char* const orig, int width, int height, int channels, unsigned char* resampled, int resampled_width, int resampled_height );
+int ref_scale_image_RGB_to_NTSC_safe( unsigned char* orig, int width, int height, int channels );
+int ref_convert_RGB_to_YCoCg( unsigned char* orig, int width, int height, int channels );
+int ref_convert_YCoCg_to_RGB( unsigned char* orig, int width, int height, int channels );
+
+static const char *default_files[] =
+{
+	"res/spindl2.png",
+	"res/island.png",
+	"res/mountains.jpg"
+};
+
+typedef int (*in_place_kernel)( unsigned char* orig, int width, int height, int channels );
+
+static double elapsed_ms( clock_t start )
+{
+	return 1000.0 * (clock() - start) / CLOCKS_PER_SEC;
+}
+
+static int report( const char *name, int channels, double ref_ms, double simd_ms,
+		int iterations, int match )
+{
+	if( !match )
+	{
+		printf( "  %-14s %d ch  MISMATCH\n", name, channels );
+		return 0;
+	}
+	printf( "  %-14s %d ch  reference %8.2f ms  simd %8.2f ms  speedup %.2fx\n",
+		name, channels, ref_ms / iterations, simd_ms / iterations,
+		simd_ms > 0.0 ? ref_ms / simd_ms : 0.0 );
+	return 1;
+}
+
+/*	\return 0 if the versions disagree, otherwise 1	*/
+static int benchmark_in_place( const char *name, in_place_kernel ref, in_place_kernel simd,
+		const unsigned char *image, int width, int height, int channels, int iterations )
+{
+	int size = width * height * channels;
+	unsigned char *a = (unsigned char*)malloc( size );
+	unsigned char *b = (unsigned char*)malloc( size );
+	double ref_ms = 0.0, simd_ms = 0.0;
+	int i, ok;
+	for( i = 0; i < iterations; ++i )
+	{
+		clock_t start;
+		memcpy( a, image, size );
+		memcpy( b, image, size );
+
+		start = clock();
+		ref( a, width, height, channels );
+		ref_ms += elapsed_ms( start );
+
+		start = clock();
+		simd( b, width, height, channels );
+		simd_ms += elapsed_ms( start );
+	}
+	ok = report( name, channels, ref_ms, simd_ms, iterations, 0 == memcmp( a, b, size ) );
+	free( a );
+	free( b );
+	return ok;
+}
+
+/*	\return 0 if the versions disagree, otherwise 1	*/
+static int benchmark_up_scale( const unsigned char *image, int width, int height, int channels,
+		int iterations )
+{
+	int new_width = 1, new_height = 1;
+	int size, i, ok;
+	unsigned char *a, *b;
+	double ref_ms = 0.0, simd_ms = 0.0;
+	/*	the next power of two, or twice the size if it already is one	*/
+	while( new_width <= width ) new_width *= 2;
+	while( new_height <= height ) new_height *= 2;
+	size = new_width * new_height * channels;
+	a = (unsigned char*)malloc( size );
+	b = (unsigned char*)malloc( size );
+	for( i = 0; i < iterations; ++i )
+	{
+		clock_t start = clock();
+		ref_up_scale_image( image, width, height, channels, a, new_width, new_height );
+		ref_ms += elapsed_ms( start );
+
+		start = clock();
+		up_scale_image( image, width, height, channels, b, new_width, new_height );
+		simd_ms += elapsed_ms( start );
+	}
+	ok = report( "up_scale_image", channels, ref_ms, simd_ms, iterations, 0 == memcmp( a, b, size ) );
+	free( a );
+	free( b );
+	return ok;
+}
+
+/*	\return 0 if any kernel disagrees or the file fails to load, otherwise 1	*/
+static int benchmark_file( const char *path, int iterations )
+{
+	int pass, ok = 1;
+	for( pass = 0; pass < 2; ++pass )
+	{
+		int width, height, channels;
+		unsigned char *image = stbi_load( path, &width, &height, &channels, pass ? 4 : 0 );
+		if( NULL == image )
+		{
+			printf( "%s cannot load: %s\n", path, stbi_failure_reason() );
+			return 0;
+		}
+		if( pass )
+		{
+			channels = 4;
+		} else
+		{
+			printf( "%s %dx%d\n", path, width, height );
+		}
+		ok &= benchmark_up_scale( image, width, height, channels, iterations );
+		ok &= benchmark_in_place( "NTSC_safe", ref_scale_image_RGB_to_NTSC_safe,
+			scale_image_RGB_to_NTSC_safe, image, width, height, channels, iterations );
+		if( channels >= 3 )
+		{
+			ok &= benchmark_in_place( "RGB_to_YCoCg", ref_convert_RGB_to_YCoCg,
+				convert_RGB_to_YCoCg, image, width, height, channels, iterations );
+			ok &= benchmark_in_place( "YCoCg_to_RGB", ref_convert_YCoCg_to_RGB,
+				convert_YCoCg_to_RGB, image, width, height, channels, iterations );
+		}
+		stbi_image_free( image );
+	}
+	return ok;
+}
+
+int main( int argc, char **argv )
+{
+	int iterations = 10;
+	int i, ok = 1;
+	if( argc > 1 )
+	{
+		iterations = atoi( argv[1] );
+		if( iterations < 1 )
+		{
+			iterations = 1;
+		}
+	}
+	if( argc > 2 )
+	{
+		for( i = 2; i < argc; ++i )
+		{
+			ok &= benchmark_file( argv[i], iterations );
+		}
+	} else
+	{
+		for( i = 0; i < (int)(sizeof( default_files ) / sizeof( default_files[0] )); ++i )
+		{
+			ok &= benchmark_file( default_files[i], iterations );
+		}
+	}
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,19 @@
+/*
+	Reference image helpers for the benchmarks: image_helper.c built
+	without its SIMD kernels, with its global symbols renamed so it can
+	be linked next to SOIL.
+*/
+
+#define IMAGE_HELPER_NO_SIMD
+
+#define up_scale_image                    ref_up_scale_image
+#define mipmap_image                      ref_mipmap_image
+#define scale_image_RGB_to_NTSC_safe      ref_scale_image_RGB_to_NTSC_safe
+#define convert_RGB_to_YCoCg              ref_convert_RGB_to_YCoCg
+#define convert_YCoCg_to_RGB              ref_convert_YCoCg_to_RGB
+#define clamp_byte                        ref_clamp_byte
+#define find_max_RGBE                     ref_find_max_RGBE
+#define RGBE_to_RGBdivA                   ref_RGBE_to_RGBdivA
+#define RGBE_to_RGBdivA2                  ref_RGBE_to_RGBdivA2
+
+#include "../SOIL/src/image_helper.c"
@@ -0,0 +1,133 @@
+/*
+	PNG decode benchmark
+
+	Decodes each PNG with the reference stb_image 1.16 decoder and with
+	stb_image_aug, reports the timings of both and checks that they
+	produced exactly the same pixels.
+
+	usage: png_benchmark [iterations] [file.png ...]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stb_image_aug.h"
+
+/*	from stb_image_reference.c	*/
+unsigned char *ref_stbi_load_from_memory( unsigned char const *buffer, int len, int *x, int *y, int *comp, int req_comp );
+char *ref_stbi_failure_reason( void );
+void ref_stbi_image_free( void *retval_from_stbi_load );
+
+static const char *default_files[] =
+{
+	"res/island.png",
+	"res/spindl.png",
+	"res/spindl2.png"
+};
+
+static unsigned char *read_file( const char *path, int *len )
+{
+	unsigned char *buffer;
+	FILE *f = fopen( path, "rb" );
+	if( NULL == f )
+	{
+		return NULL;
+	}
+	fseek( f, 0, SEEK_END );
+	*len = (int)ftell( f );
+	fseek( f, 0, SEEK_SET );
+	buffer = (unsigned char*)malloc( *len );
+	if( (NULL != buffer) && ((int)fread( buffer, 1, *len, f ) != *len) )
+	{
+		free( buffer );
+		buffer = NULL;
+	}
+	fclose( f );
+	return buffer;
+}
+
+static double elapsed_ms( clock_t start )
+{
+	return 1000.0 * (clock() - start) / CLOCKS_PER_SEC;
+}
+
+/*	\return 0 if the decoders disagree or fail, otherwise 1	*/
+static int benchmark_file( const char *path, int iterations )
+{
+	unsigned char *data, *ref = NULL, *aug = NULL;
+	double ref_ms = 0.0, aug_ms = 0.0;
+	int len, i, ok = 1;
+	int rw = 0, rh = 0, rc = 0, aw = 0, ah = 0, ac = 0;
+
+	data = read_file( path, &len );
+	if( NULL == data )
+	{
+		printf( "%-20s cannot read file\n", path );
+		return 0;
+	}
+	for( i = 0; i < iterations; ++i )
+	{
+		clock_t start;
+		if( ref ) ref_stbi_image_free( ref );
+		if( aug ) stbi_image_free( aug );
+
+		start = clock();
+		ref = ref_stbi_load_from_memory( data, len, &rw, &rh, &rc, 0 );
+		ref_ms += elapsed_ms( start );
+
+		start = clock();
+		aug = stbi_load_from_memory( data, len, &aw, &ah, &ac, 0 );
+		aug_ms += elapsed_ms( start );
+	}
+	if( (NULL == ref) && (NULL == aug) )
+	{
+		/*	both reject it (e.g. 16 bit PNGs), nothing to compare	*/
+		printf( "%-20s skipped: %s\n", path, stbi_failure_reason() );
+	} else if( (NULL == ref) || (NULL == aug) ||
+		(rw != aw) || (rh != ah) || (rc != ac) ||
+		memcmp( ref, aug, rw * rh * rc ) )
+	{
+		printf( "%-20s MISMATCH\n", path );
+		ok = 0;
+	} else
+	{
+		printf( "%-20s %5dx%-5d %d ch  reference %8.2f ms  aug %8.2f ms  speedup %.2fx\n",
+			path, aw, ah, ac,
+			ref_ms / iterations, aug_ms / iterations,
+			aug_ms > 0.0 ? ref_ms / aug_ms : 0.0 );
+	}
+	if( ref ) ref_stbi_image_free( ref );
+	if( aug ) stbi_image_free( aug );
+	free( data );
+	return ok;
+}
+
+int main( int argc, char **argv )
+{
+	int iterations = 10;
+	int i, ok = 1;
+	if( argc > 1 )
+	{
+		iterations = atoi( argv[1] );
+		if( iterations < 1 )
+		{
+			iterations = 1;
+		}
+	}
+	if( argc > 2 )
+	{
+		for( i = 2; i < argc; ++i )
+		{
+			ok &= benchmark_file( argv[i], iterations );
+		}
+	} else
+	{
+		for( i = 0; i < (int)(sizeof( default_files ) / sizeof( default_files[0] )); ++i )
+		{
+			ok &= benchmark_file( default_files[i], iterations );
+		}
+	}
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,171 @@
+/*
+	Terrain LOD seam check
+
+	Picks patch LODs and morph ranges with PatchLod as Terrain::update()
+	does, morphs the vertices along every shared patch edge as
+	outline.vert does, and checks that both patches put their edge
+	vertices in the same places.  Where they do not, the finer patch has
+	a vertex in the middle of an edge of the coarser one and the terrain
+	cracks open there.  Runs a hilly terrain from random cameras at a few
+	LOD distances, from minDistance() up.
+
+	usage: seam_check [cameras]
+*/
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "patch_lod.h"
+
+static const int Patches = 32;
+static const int Quads = 64;
+static const int Lods = 5;
+
+/* Height of a LOD 0 vertex, vertices are the only points outline.vert samples for the morph */
+static float height_at(int x, int y) {
+  return 150.0f + 120.0f * std::sin(x * 0.013f) * std::cos(y * 0.017f) + 40.0f * std::sin(x * 0.051f + y * 0.037f);
+}
+
+/* Distance from p to the box, 0 inside, like Terrain's */
+static float distance(const glm::vec3 &p, const glm::vec3 &lo, const glm::vec3 &hi) {
+  glm::vec3 d = glm::max(glm::max(lo - p, p - hi), glm::vec3(0.0f));
+  return glm::length(d);
+}
+
+struct Patch {
+  int lod;
+  float morphStart, morphEnd;
+};
+
+/*
+ * Positions along the edge, in quads from its start, that outline.vert
+ * moves the patch's edge vertices to. The edge runs from the vertex
+ * (x, y) in the direction (dx, dy).
+ */
+static std::vector<float> edge(const Patch &patch, const glm::vec3 &camera, int x, int y, int dx, int dy) {
+  int step = 1 << patch.lod;
+  std::vector<float> out;
+
+  for (int g = 0; g <= Quads; g += step) {
+    int vx = x + g * dx, vy = y + g * dy;
+    float r = glm::length(camera - glm::vec3((float) vx, (float) vy, height_at(vx, vy)));
+    float k = std::min(std::max((r - patch.morphStart) / (patch.morphEnd - patch.morphStart), 0.0f), 1.0f);
+
+    /* The edge vertices of a patch are odd along the edge only */
+    float odd = (float) (g % (2 * step));
+    out.push_back(g - odd * k);
+  }
+
+  std::sort(out.begin(), out.end());
+  out.erase(std::unique(out.begin(), out.end(), [](float a, float b) { return b - a < 1e-3f; }), out.end());
+  return out;
+}
+
+/* Farthest any position of `a` is from the nearest one of `b` */
+static float gap(const std::vector<float> &a, const std::vector<float> &b) {
+  float worst = 0.0f;
+  for (float p : a) {
+    float nearest = FLT_MAX;
+    for (float q : b) {
+      nearest = std::min(nearest, std::abs(p - q));
+    }
+    worst = std::max(worst, nearest);
+  }
+  return worst;
+}
+
+int main(int argc, char **argv) {
+  int cameras = 100;
+  if (argc > 1) {
+    cameras = std::max(atoi(argv[1]), 1);
+  }
+
+  std::vector<float> minHeights(Patches * Patches, FLT_MAX), maxHeights(Patches * Patches, -FLT_MAX);
+  float diagonal = 0.0f;
+
+  for (int py = 0; py < Patches; py++) {
+    for (int px = 0; px < Patches; px++) {
+      int i = py * Patches + px;
+      for (int y = py * Quads; y <= (py + 1) * Quads; y++) {
+        for (int x = px * Quads; x <= (px + 1) * Quads; x++) {
+          minHeights[i] = std::min(minHeights[i], height_at(x, y));
+          maxHeights[i] = std::max(maxHeights[i], height_at(x, y));
+        }
+      }
+
+      float range = maxHeights[i] - minHeights[i];
+      diagonal = std::max(diagonal, std::sqrt(2.0f * Quads * Quads + range * range));
+    }
+  }
+
+  /* Multiples of the smallest LOD distance Terrain::update() allows */
+  const float scales[] = { 1.0f, 1.5f, 3.0f };
+  std::mt19937 random { 1 };
+  std::uniform_real_distribution<float> across(0.0f, (float) Patches * Quads), above(5.0f, 300.0f);
+  bool ok = true;
+
+  for (float scale : scales) {
+    float lodDistance = scale * PatchLod::minDistance(diagonal);
+    int edges = 0, cracked = 0, lodJumps = 0;
+    float worst = 0.0f;
+
+    for (int c = 0; c < cameras; c++) {
+      float x = across(random), y = across(random);
+      glm::vec3 camera { x, y, height_at((int) x, (int) y) + above(random) };
+
+      std::vector<Patch> patches(Patches * Patches);
+      for (int py = 0; py < Patches; py++) {
+        for (int px = 0; px < Patches; px++) {
+          int i = py * Patches + px;
+          glm::vec3 lo { (float) px * Quads,       (float) py * Quads,       minHeights[i] };
+          glm::vec3 hi { (float) (px + 1) * Quads, (float) (py + 1) * Quads, maxHeights[i] };
+
+          Patch &patch = patches[i];
+          patch.lod = PatchLod::select(distance(camera, lo, hi), lodDistance, Lods);
+          PatchLod::morph(patch.lod, lodDistance, diagonal, Lods, patch.morphStart, patch.morphEnd);
+        }
+      }
+
+      /* The right and the upper edge of every patch with a neighbour there */
+      for (int py = 0; py < Patches; py++) {
+        for (int px = 0; px < Patches; px++) {
+          const Patch &patch = patches[py * Patches + px];
+
+          for (int side = 0; side < 2; side++) {
+            int nx = px + (side == 0), ny = py + (side == 1);
+            if (nx >= Patches || ny >= Patches) {
+              continue;
+            }
+
+            const Patch &neighbour = patches[ny * Patches + nx];
+            int x = side == 0 ? nx * Quads : px * Quads;
+            int y = side == 0 ? py * Quads : ny * Quads;
+            int dx = side == 0 ? 0 : 1, dy = side == 0 ? 1 : 0;
+
+            std::vector<float> a = edge(patch, camera, x, y, dx, dy);
+            std::vector<float> b = edge(neighbour, camera, x, y, dx, dy);
+
+            float off = std::max(gap(a, b), gap(b, a));
+            edges++;
+            cracked += off > 1e-3f;
+            lodJumps += std::abs(patch.lod - neighbour.lod) > 1;
+            worst = std::max(worst, off);
+          }
+        }
+      }
+    }
+
+    printf("LOD distance %7.1f  %7d edges  %5d cracked  %5d LOD jumps  worst %.3f quads\n",
+           lodDistance, edges, cracked, lodJumps, worst);
+    ok &= cracked == 0 && lodJumps == 0;
+  }
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,36 @@
+/*
+	Reference decoder for the benchmarks: the unmodified stb_image 1.16
+	that stb_image_aug is based on, with its global symbols renamed so it
+	can be linked next to SOIL.
+*/
+
+#define STBI_NO_STDIO
+#define STBI_NO_HDR
+#define STBI_NO_WRITE
+
+#define loaders                           ref_loaders
+#define stbi_bmp_load_from_memory         ref_stbi_bmp_load_from_memory
+#define stbi_bmp_test_memory              ref_stbi_bmp_test_memory
+#define stbi_failure_reason               ref_stbi_failure_reason
+#define stbi_image_free                   ref_stbi_image_free
+#define stbi_info_from_memory             ref_stbi_info_from_memory
+#define stbi_is_hdr_from_memory           ref_stbi_is_hdr_from_memory
+#define stbi_jpeg_info_from_memory        ref_stbi_jpeg_info_from_memory
+#define stbi_jpeg_load_from_memory        ref_stbi_jpeg_load_from_memory
+#define stbi_jpeg_test_memory             ref_stbi_jpeg_test_memory
+#define stbi_load_from_memory             ref_stbi_load_from_memory
+#define stbi_png_info_from_memory         ref_stbi_png_info_from_memory
+#define stbi_png_load_from_memory         ref_stbi_png_load_from_memory
+#define stbi_png_test_memory              ref_stbi_png_test_memory
+#define stbi_psd_load_from_memory         ref_stbi_psd_load_from_memory
+#define stbi_psd_test_memory              ref_stbi_psd_test_memory
+#define stbi_register_loader              ref_stbi_register_loader
+#define stbi_tga_load_from_memory         ref_stbi_tga_load_from_memory
+#define stbi_tga_test_memory              ref_stbi_tga_test_memory
+#define stbi_zlib_decode_buffer           ref_stbi_zlib_decode_buffer
+#define stbi_zlib_decode_malloc           ref_stbi_zlib_decode_malloc
+#define stbi_zlib_decode_malloc_guesssize ref_stbi_zlib_decode_malloc_guesssize
+#define stbi_zlib_decode_noheader_buffer  ref_stbi_zlib_decode_noheader_buffer
+#define stbi_zlib_decode_noheader_malloc  ref_stbi_zlib_decode_noheader_malloc
+
+#include "../SOIL/src/original/stb_image-1.16.c"
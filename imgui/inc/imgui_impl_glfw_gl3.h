@@ -7,11 +7,22 @@
 // https://github.com/ocornut/imgui
 
 struct GLFWwindow;
+class StreamBuffer;
 
 IMGUI_API bool        ImGui_ImplGlfwGL3_Init(GLFWwindow* window, bool install_callbacks);
 IMGUI_API void        ImGui_ImplGlfwGL3_Shutdown();
 IMGUI_API void        ImGui_ImplGlfwGL3_NewFrame();
 
+// Stream vertices and indices through a StreamBuffer (see stream_buffer.h) instead of reallocating buffers every frame.
+// The buffer must outlive the binding, or be unset with NULL. The caller ends its frames.
+IMGUI_API void        ImGui_ImplGlfwGL3_SetStreamBuffer(StreamBuffer* stream_buffer);
+
+// Hash the draw data and skip the upload when it equals the last frame's (the draws still happen).
+// While caching, vertices and indices stay in the binding's own buffers instead of the stream buffer.
+IMGUI_API void        ImGui_ImplGlfwGL3_SetCacheDrawData(bool enabled);
+// Whether the last rendered draw data differed from the frame before (always true when not caching).
+IMGUI_API bool        ImGui_ImplGlfwGL3_DrawDataChanged();
+
 // Use if you want to reset your rendering device without losing ImGui state.
 IMGUI_API void        ImGui_ImplGlfwGL3_InvalidateDeviceObjects();
 IMGUI_API bool        ImGui_ImplGlfwGL3_CreateDeviceObjects();
@@ -7,6 +7,7 @@
 // https://github.com/ocornut/imgui
 
 #include <imgui.h>
+#include <string.h>
 #include "imgui_impl_glfw_gl3.h"
 
 // GLEW/GLFW
@@ -19,6 +20,9 @@
 #include <GLFW/glfw3native.h>
 #endif
 
+#include "gl_state.h"
+#include "stream_buffer.h"
+
 // Data
 static GLFWwindow*  g_Window = NULL;
 static double       g_Time = 0.0f;
@@ -29,6 +33,80 @@ static int          g_ShaderHandle = 0, g_VertHandle = 0, g_FragHandle = 0;
 static int          g_AttribLocationTex = 0, g_AttribLocationProjMtx = 0;
 static int          g_AttribLocationPosition = 0, g_AttribLocationUV = 0, g_AttribLocationColor = 0;
 static unsigned int g_VboHandle = 0, g_VaoHandle = 0, g_ElementsHandle = 0;
+static StreamBuffer* g_StreamBuffer = NULL;
+static bool         g_CacheDrawData = false, g_DrawDataCached = false, g_DrawDataChanged = true;
+static unsigned long long g_DrawDataHash = 0;
+static GLsizeiptr   g_VboSize = 0, g_ElementsSize = 0;
+
+void ImGui_ImplGlfwGL3_SetStreamBuffer(StreamBuffer* stream_buffer)
+{
+    g_StreamBuffer = stream_buffer;
+}
+
+void ImGui_ImplGlfwGL3_SetCacheDrawData(bool enabled)
+{
+    g_CacheDrawData = enabled;
+    g_DrawDataCached = false;
+}
+
+bool ImGui_ImplGlfwGL3_DrawDataChanged()
+{
+    return g_DrawDataChanged;
+}
+
+// Word-at-a-time hash, only has to tell one frame's draw data from the next
+static unsigned long long ImGui_ImplGlfwGL3_Hash(unsigned long long h, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (; size >= 8; bytes += 8, size -= 8)
+    {
+        unsigned long long word;
+        memcpy(&word, bytes, 8);
+        h = ((h << 5 | h >> 59) ^ word) * 0x9E3779B97F4A7C15ULL;
+    }
+    if (size > 0)
+    {
+        unsigned long long word = 0;
+        memcpy(&word, bytes, size);
+        h = ((h << 5 | h >> 59) ^ word) * 0x9E3779B97F4A7C15ULL;
+    }
+    return h;
+}
+
+static unsigned long long ImGui_ImplGlfwGL3_HashDrawData(const ImDrawData* draw_data, int fb_height)
+{
+    unsigned long long h = ImGui_ImplGlfwGL3_Hash(0, &fb_height, sizeof(fb_height));
+    h = ImGui_ImplGlfwGL3_Hash(h, &draw_data->CmdListsCount, sizeof(draw_data->CmdListsCount));
+    for (int n = 0; n < draw_data->CmdListsCount; n++)
+    {
+        const ImDrawList* cmd_list = draw_data->CmdLists[n];
+        h = ImGui_ImplGlfwGL3_Hash(h, &cmd_list->VtxBuffer.Size, sizeof(int));
+        h = ImGui_ImplGlfwGL3_Hash(h, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
+        h = ImGui_ImplGlfwGL3_Hash(h, &cmd_list->IdxBuffer.Size, sizeof(int));
+        h = ImGui_ImplGlfwGL3_Hash(h, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
+        for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++)
+        {
+            // Field by field, ImDrawCmd has padding
+            const ImDrawCmd* pcmd = &cmd_list->CmdBuffer[cmd_i];
+            h = ImGui_ImplGlfwGL3_Hash(h, &pcmd->ElemCount, sizeof(pcmd->ElemCount));
+            h = ImGui_ImplGlfwGL3_Hash(h, &pcmd->ClipRect, sizeof(pcmd->ClipRect));
+            h = ImGui_ImplGlfwGL3_Hash(h, &pcmd->TextureId, sizeof(pcmd->TextureId));
+            h = ImGui_ImplGlfwGL3_Hash(h, &pcmd->UserCallback, sizeof(pcmd->UserCallback));
+            h = ImGui_ImplGlfwGL3_Hash(h, &pcmd->UserCallbackData, sizeof(pcmd->UserCallbackData));
+        }
+    }
+    return h;
+}
+
+// Points the vertex attributes at ImDrawVert data starting at 'offset' in the bound GL_ARRAY_BUFFER
+static void ImGui_ImplGlfwGL3_SetupVertexAttribs(size_t offset)
+{
+#define OFFSETOF(TYPE, ELEMENT) ((size_t)&(((TYPE *)0)->ELEMENT))
+    glVertexAttribPointer(g_AttribLocationPosition, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid*)(offset + OFFSETOF(ImDrawVert, pos)));
+    glVertexAttribPointer(g_AttribLocationUV, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid*)(offset + OFFSETOF(ImDrawVert, uv)));
+    glVertexAttribPointer(g_AttribLocationColor, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ImDrawVert), (GLvoid*)(offset + OFFSETOF(ImDrawVert, col)));
+#undef OFFSETOF
+}
 
 // This is the main rendering function that you have to implement and provide to ImGui (via setting up 'RenderDrawListsFn' in the ImGuiIO structure)
 // If text or lines are blurry when integrating ImGui in your engine:
@@ -43,32 +121,18 @@ void ImGui_ImplGlfwGL3_RenderDrawLists(ImDrawData* draw_data)
         return;
     draw_data->ScaleClipRects(io.DisplayFramebufferScale);
 
-    // Backup GL state
-    GLint last_program; glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
-    GLint last_texture; glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture);
-    GLint last_active_texture; glGetIntegerv(GL_ACTIVE_TEXTURE, &last_active_texture);
-    GLint last_array_buffer; glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &last_array_buffer);
-    GLint last_element_array_buffer; glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &last_element_array_buffer);
-    GLint last_vertex_array; glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &last_vertex_array);
-    GLint last_blend_src; glGetIntegerv(GL_BLEND_SRC, &last_blend_src);
-    GLint last_blend_dst; glGetIntegerv(GL_BLEND_DST, &last_blend_dst);
-    GLint last_blend_equation_rgb; glGetIntegerv(GL_BLEND_EQUATION_RGB, &last_blend_equation_rgb);
-    GLint last_blend_equation_alpha; glGetIntegerv(GL_BLEND_EQUATION_ALPHA, &last_blend_equation_alpha);
+    // The state tracker (see gl_state.h) knows the program, vertex array, textures, blend and depth state,
+    // so those are neither queried nor restored; whoever draws next sets what it needs. Only the viewport is backed up.
+    GLState& state = GLState::current();
     GLint last_viewport[4]; glGetIntegerv(GL_VIEWPORT, last_viewport);
-    GLint last_scissor_box[4]; glGetIntegerv(GL_SCISSOR_BOX, last_scissor_box); 
-    GLboolean last_enable_blend = glIsEnabled(GL_BLEND);
-    GLboolean last_enable_cull_face = glIsEnabled(GL_CULL_FACE);
-    GLboolean last_enable_depth_test = glIsEnabled(GL_DEPTH_TEST);
-    GLboolean last_enable_scissor_test = glIsEnabled(GL_SCISSOR_TEST);
 
     // Setup render state: alpha-blending enabled, no face culling, no depth testing, scissor enabled
-    glEnable(GL_BLEND);
-    glBlendEquation(GL_FUNC_ADD);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glDisable(GL_CULL_FACE);
-    glDisable(GL_DEPTH_TEST);
-    glEnable(GL_SCISSOR_TEST);
-    glActiveTexture(GL_TEXTURE0);
+    state.enable(GL_BLEND);
+    state.setBlendEquation(GL_FUNC_ADD);
+    state.setBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    state.disable(GL_CULL_FACE);
+    state.disable(GL_DEPTH_TEST);
+    state.enable(GL_SCISSOR_TEST);
 
     // Setup viewport, orthographic projection matrix
     glViewport(0, 0, (GLsizei)fb_width, (GLsizei)fb_height);
@@ -79,54 +143,142 @@ void ImGui_ImplGlfwGL3_RenderDrawLists(ImDrawData* draw_data)
         { 0.0f,                  0.0f,                  -1.0f, 0.0f },
         {-1.0f,                  1.0f,                   0.0f, 1.0f },
     };
-    glUseProgram(g_ShaderHandle);
+    state.useProgram(g_ShaderHandle);
     glUniform1i(g_AttribLocationTex, 0);
     glUniformMatrix4fv(g_AttribLocationProjMtx, 1, GL_FALSE, &ortho_projection[0][0]);
-    glBindVertexArray(g_VaoHandle);
+    state.bindVertexArray(g_VaoHandle);
 
-    for (int n = 0; n < draw_data->CmdListsCount; n++)
+    // When caching, unchanged frames draw again from what is already in the binding's own buffers
+    bool upload = true;
+    if (g_CacheDrawData)
     {
-        const ImDrawList* cmd_list = draw_data->CmdLists[n];
-        const ImDrawIdx* idx_buffer_offset = 0;
+        unsigned long long hash = ImGui_ImplGlfwGL3_HashDrawData(draw_data, fb_height);
+        g_DrawDataChanged = !g_DrawDataCached || hash != g_DrawDataHash;
+        g_DrawDataHash = hash;
+        g_DrawDataCached = true;
+        upload = g_DrawDataChanged;
+    }
+    else
+    {
+        g_DrawDataChanged = true;
+    }
 
-        glBindBuffer(GL_ARRAY_BUFFER, g_VboHandle);
-        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)cmd_list->VtxBuffer.Size * sizeof(ImDrawVert), (GLvoid*)cmd_list->VtxBuffer.Data, GL_STREAM_DRAW);
+    if (draw_data->TotalIdxCount > 0)
+    {
+        // Upload the vertices and indices of all command lists at once, each list then draws with its base vertex
+        GLsizeiptr vtx_size = (GLsizeiptr)draw_data->TotalVtxCount * sizeof(ImDrawVert);
+        GLsizeiptr idx_size = (GLsizeiptr)draw_data->TotalIdxCount * sizeof(ImDrawIdx);
+        GLintptr vtx_offset = 0, idx_offset = 0;
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_ElementsHandle);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx), (GLvoid*)cmd_list->IdxBuffer.Data, GL_STREAM_DRAW);
+        if (!upload)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, g_VboHandle);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_ElementsHandle);
+        }
+        else if (g_StreamBuffer && !g_CacheDrawData)
+        {
+            // Suballocate from the ring, no storage is reallocated
+            ImDrawVert* vtx_dst = (ImDrawVert*)g_StreamBuffer->map(vtx_size, 4, vtx_offset);
+            for (int n = 0; n < draw_data->CmdListsCount; n++)
+            {
+                const ImDrawList* cmd_list = draw_data->CmdLists[n];
+                memcpy(vtx_dst, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
+                vtx_dst += cmd_list->VtxBuffer.Size;
+            }
+            g_StreamBuffer->unmap();
 
-        for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++)
+            ImDrawIdx* idx_dst = (ImDrawIdx*)g_StreamBuffer->map(idx_size, sizeof(ImDrawIdx), idx_offset);
+            for (int n = 0; n < draw_data->CmdListsCount; n++)
+            {
+                const ImDrawList* cmd_list = draw_data->CmdLists[n];
+                memcpy(idx_dst, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
+                idx_dst += cmd_list->IdxBuffer.Size;
+            }
+            g_StreamBuffer->unmap();
+
+            glBindBuffer(GL_ARRAY_BUFFER, *g_StreamBuffer);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, *g_StreamBuffer);
+        }
+        else
         {
-            const ImDrawCmd* pcmd = &cmd_list->CmdBuffer[cmd_i];
-            if (pcmd->UserCallback)
+            // Orphan and refill, growing the storage only when it is too small
+            if (g_VboSize < vtx_size)
+                g_VboSize = vtx_size > 2 * g_VboSize ? vtx_size : 2 * g_VboSize;
+            if (g_ElementsSize < idx_size)
+                g_ElementsSize = idx_size > 2 * g_ElementsSize ? idx_size : 2 * g_ElementsSize;
+
+            glBindBuffer(GL_ARRAY_BUFFER, g_VboHandle);
+            glBufferData(GL_ARRAY_BUFFER, g_VboSize, NULL, GL_STREAM_DRAW);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_ElementsHandle);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, g_ElementsSize, NULL, GL_STREAM_DRAW);
+
+            GLintptr vtx_dst = 0, idx_dst = 0;
+            for (int n = 0; n < draw_data->CmdListsCount; n++)
             {
-                pcmd->UserCallback(cmd_list, pcmd);
+                const ImDrawList* cmd_list = draw_data->CmdLists[n];
+                glBufferSubData(GL_ARRAY_BUFFER, vtx_dst, (GLsizeiptr)cmd_list->VtxBuffer.Size * sizeof(ImDrawVert), (GLvoid*)cmd_list->VtxBuffer.Data);
+                glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, idx_dst, (GLsizeiptr)cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx), (GLvoid*)cmd_list->IdxBuffer.Data);
+                vtx_dst += (GLintptr)cmd_list->VtxBuffer.Size * sizeof(ImDrawVert);
+                idx_dst += (GLintptr)cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx);
             }
-            else
+        }
+        ImGui_ImplGlfwGL3_SetupVertexAttribs((size_t)vtx_offset);
+
+        // Only touch the scissor when it changes, the tracker does the same for the texture
+        bool state_known = false;
+        ImVec4 clip_rect;
+
+        const ImDrawIdx* idx_buffer_offset = (const ImDrawIdx*)(intptr_t)idx_offset;
+        GLint base_vertex = 0;
+        for (int n = 0; n < draw_data->CmdListsCount; n++)
+        {
+            const ImDrawList* cmd_list = draw_data->CmdLists[n];
+            for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; )
             {
-                glBindTexture(GL_TEXTURE_2D, (GLuint)(intptr_t)pcmd->TextureId);
-                glScissor((int)pcmd->ClipRect.x, (int)(fb_height - pcmd->ClipRect.w), (int)(pcmd->ClipRect.z - pcmd->ClipRect.x), (int)(pcmd->ClipRect.w - pcmd->ClipRect.y));
-                glDrawElements(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, idx_buffer_offset);
+                const ImDrawCmd* pcmd = &cmd_list->CmdBuffer[cmd_i];
+                if (pcmd->UserCallback)
+                {
+                    pcmd->UserCallback(cmd_list, pcmd);
+                    idx_buffer_offset += pcmd->ElemCount;
+                    state.invalidate();
+                    state.useProgram(g_ShaderHandle);
+                    state.bindVertexArray(g_VaoHandle);
+                    state_known = false;
+                    cmd_i++;
+                    continue;
+                }
+
+                // Coalesce the following commands that use the same texture and clip rect
+                unsigned int elem_count = pcmd->ElemCount;
+                int next = cmd_i + 1;
+                for (; next < cmd_list->CmdBuffer.Size; next++)
+                {
+                    const ImDrawCmd* ncmd = &cmd_list->CmdBuffer[next];
+                    if (ncmd->UserCallback || ncmd->TextureId != pcmd->TextureId ||
+                        ncmd->ClipRect.x != pcmd->ClipRect.x || ncmd->ClipRect.y != pcmd->ClipRect.y ||
+                        ncmd->ClipRect.z != pcmd->ClipRect.z || ncmd->ClipRect.w != pcmd->ClipRect.w)
+                        break;
+                    elem_count += ncmd->ElemCount;
+                }
+
+                state.bindTexture(0, GL_TEXTURE_2D, (GLuint)(intptr_t)pcmd->TextureId);
+                if (!state_known || pcmd->ClipRect.x != clip_rect.x || pcmd->ClipRect.y != clip_rect.y ||
+                    pcmd->ClipRect.z != clip_rect.z || pcmd->ClipRect.w != clip_rect.w)
+                    glScissor((int)pcmd->ClipRect.x, (int)(fb_height - pcmd->ClipRect.w), (int)(pcmd->ClipRect.z - pcmd->ClipRect.x), (int)(pcmd->ClipRect.w - pcmd->ClipRect.y));
+                state_known = true;
+                clip_rect = pcmd->ClipRect;
+
+                glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)elem_count, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, idx_buffer_offset, base_vertex);
+                idx_buffer_offset += elem_count;
+                cmd_i = next;
             }
-            idx_buffer_offset += pcmd->ElemCount;
+            base_vertex += cmd_list->VtxBuffer.Size;
         }
     }
 
-    // Restore modified GL state
-    glUseProgram(last_program);
-    glActiveTexture(last_active_texture);
-    glBindTexture(GL_TEXTURE_2D, last_texture);
-    glBindVertexArray(last_vertex_array);
-    glBindBuffer(GL_ARRAY_BUFFER, last_array_buffer);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, last_element_array_buffer);
-    glBlendEquationSeparate(last_blend_equation_rgb, last_blend_equation_alpha);
-    glBlendFunc(last_blend_src, last_blend_dst);
-    if (last_enable_blend) glEnable(GL_BLEND); else glDisable(GL_BLEND);
-    if (last_enable_cull_face) glEnable(GL_CULL_FACE); else glDisable(GL_CULL_FACE);
-    if (last_enable_depth_test) glEnable(GL_DEPTH_TEST); else glDisable(GL_DEPTH_TEST);
-    if (last_enable_scissor_test) glEnable(GL_SCISSOR_TEST); else glDisable(GL_SCISSOR_TEST);
+    // Restore the untracked state
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
     glViewport(last_viewport[0], last_viewport[1], (GLsizei)last_viewport[2], (GLsizei)last_viewport[3]);
-    glScissor(last_scissor_box[0], last_scissor_box[1], (GLsizei)last_scissor_box[2], (GLsizei)last_scissor_box[3]);
 }
 
 static const char* ImGui_ImplGlfwGL3_GetClipboardText(void* user_data)
@@ -259,11 +411,7 @@ bool ImGui_ImplGlfwGL3_CreateDeviceObjects()
     glEnableVertexAttribArray(g_AttribLocationUV);
     glEnableVertexAttribArray(g_AttribLocationColor);
 
-#define OFFSETOF(TYPE, ELEMENT) ((size_t)&(((TYPE *)0)->ELEMENT))
-    glVertexAttribPointer(g_AttribLocationPosition, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid*)OFFSETOF(ImDrawVert, pos));
-    glVertexAttribPointer(g_AttribLocationUV, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid*)OFFSETOF(ImDrawVert, uv));
-    glVertexAttribPointer(g_AttribLocationColor, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ImDrawVert), (GLvoid*)OFFSETOF(ImDrawVert, col));
-#undef OFFSETOF
+    ImGui_ImplGlfwGL3_SetupVertexAttribs(0);
 
     ImGui_ImplGlfwGL3_CreateFontsTexture();
 
@@ -281,6 +429,8 @@ void    ImGui_ImplGlfwGL3_InvalidateDeviceObjects()
     if (g_VboHandle) glDeleteBuffers(1, &g_VboHandle);
     if (g_ElementsHandle) glDeleteBuffers(1, &g_ElementsHandle);
     g_VaoHandle = g_VboHandle = g_ElementsHandle = 0;
+    g_VboSize = g_ElementsSize = 0;
+    g_DrawDataCached = false;
 
     if (g_ShaderHandle && g_VertHandle) glDetachShader(g_ShaderHandle, g_VertHandle);
     if (g_VertHandle) glDeleteShader(g_VertHandle);
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include <stb_image_aug.h>
+
+/*
+ * Reads rendered frames back to the CPU without waiting for them. Every
+ * capture() starts an asynchronous glReadPixels into one of two pixel pack
+ * buffers and only then maps the other one, filled a frame earlier, which
+ * the GPU is done with by now. Frames therefore come out one capture()
+ * late; finish() hands out the last one.
+ *
+ * Pixels are RGBA, top row first, and go to a sink together with their
+ * frame number, see save() for writing them to files and FrameWriter for
+ * doing that off the render thread.
+ */
+class FrameCapture {
+  public:
+    static const int Buffers = 2;
+
+    typedef std::function<void(int frame, std::vector<uint8_t> &&pixels)> Sink;
+
+  private:
+    GLuint pbos[Buffers];
+    int _w, _h;
+    Sink sink;
+
+    /* Frames read into the buffers and frames handed to the sink */
+    int issued, delivered;
+
+    void deliver() {
+      size_t row = (size_t) _w * 4;
+      std::vector<uint8_t> pixels(row * _h);
+
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[delivered % Buffers]);
+      const uint8_t *mapped = (const uint8_t *) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, row * _h, GL_MAP_READ_BIT);
+
+      if (mapped == nullptr) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        throw std::runtime_error { "Could not map a frame capture buffer" };
+      }
+
+      /* GL rows go bottom up */
+      for (int y = 0; y < _h; y++) {
+        std::memcpy(&pixels[y * row], mapped + (_h - 1 - y) * row, row);
+      }
+
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+      sink(delivered++, std::move(pixels));
+    }
+
+  public:
+    const int &width;
+    const int &height;
+
+    FrameCapture(int w, int h, Sink sink)
+      : width  { _w }
+      , height { _h }
+      , _w { w }
+      , _h { h }
+      , sink { std::move(sink) }
+      , issued { 0 }
+      , delivered { 0 }
+    {
+      glGenBuffers(Buffers, pbos);
+
+      for (GLuint pbo : pbos) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr) _w * _h * 4, nullptr, GL_STREAM_READ);
+      }
+
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    FrameCapture(const FrameCapture &) = delete;
+    FrameCapture & operator=(const FrameCapture &) = delete;
+
+    ~FrameCapture() {
+      glDeleteBuffers(Buffers, pbos);
+    }
+
+    /* Frames captured so far, handed out or not */
+    int frames() const {
+      return issued;
+    }
+
+    /* Starts reading the colors of `framebuffer` and hands out the frame before */
+    void capture(GLuint framebuffer) {
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[issued % Buffers]);
+        glReadPixels(0, 0, _w, _h, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+      issued++;
+
+      if (issued - delivered > 1) {
+        deliver();
+      }
+    }
+
+    /* Hands out the frame still being read, waiting for it */
+    void finish() {
+      while (delivered < issued) {
+        deliver();
+      }
+    }
+
+    /*
+     * Writes RGBA pixels to `path`, as a TGA or BMP file by the extension,
+     * or as they are for ".raw", the bytes a golden image test can compare
+     * directly. Safe on any thread, unlike SOIL_save_image(), which sets
+     * SOIL's shared result string.
+     */
+    static void save(const std::string &path, int w, int h, const std::vector<uint8_t> &pixels) {
+      auto extension = [&](const char *e) {
+        size_t n = std::strlen(e);
+        return path.size() >= n && path.compare(path.size() - n, n, e) == 0;
+      };
+
+      if (extension(".raw")) {
+        FILE *f = fopen(path.c_str(), "wb");
+        bool written = f != nullptr && fwrite(pixels.data(), 1, pixels.size(), f) == pixels.size();
+
+        if (f != nullptr && fclose(f) != 0) {
+          written = false;
+        }
+
+        if (!written) {
+          throw std::runtime_error { "Could not write '" + path + "'" };
+        }
+        return;
+      }
+
+      /* What SOIL_save_image() calls for these types */
+      void *data = (void *) pixels.data();
+      int saved = extension(".bmp") ? stbi_write_bmp(path.c_str(), w, h, 4, data)
+                                    : stbi_write_tga(path.c_str(), w, h, 4, data);
+      if (!saved) {
+        throw std::runtime_error { "Could not write '" + path + "'" };
+      }
+    }
+};
+
+/*
+ * Encodes and writes captured frames on a pool of worker threads, so the
+ * render thread only copies pixels out of the capture buffers. At most two
+ * frames per worker wait in the queue, write() blocks beyond that instead
+ * of piling up frames in memory when the disk cannot keep up.
+ *
+ * Frames go to directory/frame_NNNNN.format, see FrameCapture::save() for
+ * the formats. The first error is kept and thrown by the next write() or
+ * by finish().
+ */
+class FrameWriter {
+  private:
+    struct Frame {
+      int number;
+      std::vector<uint8_t> pixels;
+    };
+
+    std::string directory, format;
+    int w, h;
+
+    std::mutex mutex;
+    std::condition_variable queued, taken;
+    std::deque<Frame> frames;
+    size_t capacity;
+    bool done;
+
+    std::string error;
+    std::vector<std::thread> pool;
+
+    void work() {
+      while (true) {
+        Frame frame;
+        {
+          std::unique_lock<std::mutex> lock { mutex };
+          queued.wait(lock, [&] { return !frames.empty() || done; });
+          if (frames.empty()) {
+            return;
+          }
+
+          frame = std::move(frames.front());
+          frames.pop_front();
+        }
+        taken.notify_one();
+
+        char file[32];
+        snprintf(file, sizeof(file), "/frame_%05d.", frame.number);
+
+        try {
+          FrameCapture::save(directory + file + format, w, h, frame.pixels);
+        }
+        catch (const std::exception &e) {
+          std::lock_guard<std::mutex> lock { mutex };
+          if (error.empty()) {
+            error = e.what();
+          }
+        }
+      }
+    }
+
+    void join() {
+      {
+        std::lock_guard<std::mutex> lock { mutex };
+        done = true;
+      }
+      queued.notify_all();
+
+      for (auto &t : pool) {
+        t.join();
+      }
+      pool.clear();
+    }
+
+  public:
+    FrameWriter(const std::string &directory, const std::string &format, int w, int h,
+                unsigned workers = std::thread::hardware_concurrency())
+      : directory { directory }
+      , format { format }
+      , w { w }
+      , h { h }
+      , capacity { 2 * (size_t) (workers > 0 ? workers : 1) }
+      , done { false }
+    {
+      for (unsigned i = 0; i < (workers > 0 ? workers : 1); i++) {
+        pool.emplace_back([this]() { work(); });
+      }
+    }
+
+    FrameWriter(const FrameWriter &) = delete;
+    FrameWriter & operator=(const FrameWriter &) = delete;
+
+    ~FrameWriter() {
+      join();
+    }
+
+    /* Queues a frame, waiting while the queue is full */
+    void write(int number, std::vector<uint8_t> &&pixels) {
+      {
+        std::unique_lock<std::mutex> lock { mutex };
+        taken.wait(lock, [&] { return frames.size() < capacity || !error.empty(); });
+
+        if (!error.empty()) {
+          throw std::runtime_error { error };
+        }
+
+        frames.push_back({ number, std::move(pixels) });
+      }
+      queued.notify_one();
+    }
+
+    /* Waits until every queued frame is written */
+    void finish() {
+      join();
+
+      if (!error.empty()) {
+        throw std::runtime_error { error };
+      }
+    }
+};
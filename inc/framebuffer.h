@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdexcept>
+
+#include <GL/glew.h>
+
+/*
+ * An offscreen render target with an RGBA8 color buffer and a 32-bit float
+ * depth buffer. Window framebuffers usually come with 24-bit fixed point
+ * depth, which reverse-Z cannot make use of: its precision is in the float
+ * exponent, near 0 where the far distances end up.
+ *
+ * Draw into it after bind(), then blit() the colors to the window.
+ */
+class Framebuffer {
+  private:
+    GLuint id;
+    GLuint color, depth;
+    int _w, _h;
+
+  public:
+    const int &width;
+    const int &height;
+
+    Framebuffer(int w, int h)
+      : width  { _w }
+      , height { _h }
+      , _w { w }
+      , _h { h }
+    {
+      glGenRenderbuffers(1, &color);
+      glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, _w, _h);
+
+      glGenRenderbuffers(1, &depth);
+      glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, _w, _h);
+      glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+      glGenFramebuffers(1, &id);
+      glBindFramebuffer(GL_FRAMEBUFFER, id);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,  GL_RENDERBUFFER, depth);
+
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+      glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+      if (status != GL_FRAMEBUFFER_COMPLETE) {
+        glDeleteFramebuffers(1, &id);
+        glDeleteRenderbuffers(1, &color);
+        glDeleteRenderbuffers(1, &depth);
+
+        throw std::runtime_error { "Framebuffer incomplete" };
+      }
+    }
+
+    Framebuffer(const Framebuffer &) = delete;
+    Framebuffer & operator=(const Framebuffer &) = delete;
+
+    ~Framebuffer() {
+      glDeleteFramebuffers(1, &id);
+      glDeleteRenderbuffers(1, &color);
+      glDeleteRenderbuffers(1, &depth);
+    }
+
+    operator GLuint() const {
+      return id;
+    }
+
+    /* Draws go here, over the whole target */
+    void bind() {
+      glBindFramebuffer(GL_FRAMEBUFFER, id);
+      glViewport(0, 0, _w, _h);
+    }
+
+    /*
+     * Copies the colors to `target` (0 is the window) scaled to w x h, and
+     * leaves `target` bound for the draws that follow. The copy is clipped
+     * by the scissor test and the color mask, have both open.
+     */
+    void blit(GLuint target, int w, int h) {
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, id);
+      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+      glBlitFramebuffer(0, 0, _w, _h, 0, 0, w, h, GL_COLOR_BUFFER_BIT, _w == w && _h == h ? GL_NEAREST : GL_LINEAR);
+
+      glBindFramebuffer(GL_FRAMEBUFFER, target);
+      glViewport(0, 0, w, h);
+    }
+};
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+
+/*
+ * Shadow of the GL state the renderer switches all the time: the program,
+ * the vertex array, the textures bound to every unit, blending, depth
+ * testing, the color mask and the clip space depth range. Every change
+ * goes through here and calls that would not change anything are skipped,
+ * so nothing has to be unbound or restored after a draw any more.
+ *
+ * The shadow only holds while all changes to that state go through it.
+ * Code that changes it directly, like the setup code creating textures and
+ * vertex arrays, calls invalidate() afterwards so the next calls are issued
+ * again.
+ */
+class GLState {
+  public:
+    struct Stats {
+      int issued;
+      int avoided;
+    };
+
+  private:
+    /* Marks a value as unknown, no GL name or enum is ever this */
+    static const GLuint Unknown = ~0u;
+
+    struct Unit {
+      GLuint texture2D;
+      GLuint textureArray;
+    };
+
+    GLuint program;
+    GLuint vao;
+    GLuint activeUnit;
+    std::vector<Unit> units;
+
+    /* Capabilities, Unknown, GL_FALSE or GL_TRUE */
+    GLuint blend, depthTest, cullFace, scissorTest;
+    GLuint blendEquation, blendSrc, blendDst;
+    GLuint depthFunc, depthMask;
+    GLuint colorMask;
+    GLuint clipDepth;
+
+    Stats _stats;
+
+    /* Counts the call and tells whether it has to be issued */
+    bool change(GLuint &current, GLuint value) {
+      if (current == value) {
+        _stats.avoided++;
+        return false;
+      }
+
+      current = value;
+      _stats.issued++;
+      return true;
+    }
+
+    GLuint * capability(GLenum cap) {
+      switch (cap) {
+        case GL_BLEND:        return &blend;
+        case GL_DEPTH_TEST:   return &depthTest;
+        case GL_CULL_FACE:    return &cullFace;
+        case GL_SCISSOR_TEST: return &scissorTest;
+        default:              return nullptr;
+      }
+    }
+
+    GLState()
+      : stats { _stats }
+      , _stats { 0, 0 }
+    {
+      invalidate();
+    }
+
+  public:
+    const Stats &stats;
+
+    /* The state of the one context the application renders with */
+    static GLState & current() {
+      static GLState state;
+      return state;
+    }
+
+    GLState(const GLState &) = delete;
+    GLState & operator=(const GLState &) = delete;
+
+    /* Forgets everything, the next call of each kind is issued */
+    void invalidate() {
+      program = vao = activeUnit = Unknown;
+      units.assign(units.size(), { Unknown, Unknown });
+
+      blend = depthTest = cullFace = scissorTest = Unknown;
+      blendEquation = blendSrc = blendDst = Unknown;
+      depthFunc = depthMask = Unknown;
+      colorMask = Unknown;
+      clipDepth = Unknown;
+    }
+
+    void resetStats() {
+      _stats = { 0, 0 };
+    }
+
+    GLuint currentProgram() const {
+      return program;
+    }
+
+    void useProgram(GLuint id) {
+      if (change(program, id)) {
+        glUseProgram(id);
+      }
+    }
+
+    void bindVertexArray(GLuint id) {
+      if (change(vao, id)) {
+        glBindVertexArray(id);
+      }
+    }
+
+    void setActiveUnit(GLint unit) {
+      if (change(activeUnit, unit)) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+      }
+    }
+
+    /* Only switches the active unit when a binding actually changes */
+    void bindTexture(GLint unit, GLenum target, GLuint id) {
+      if ((size_t) unit >= units.size()) {
+        units.resize(unit + 1, { Unknown, Unknown });
+      }
+
+      GLuint *bound = nullptr;
+      switch (target) {
+        case GL_TEXTURE_2D:       bound = &units[unit].texture2D;    break;
+        case GL_TEXTURE_2D_ARRAY: bound = &units[unit].textureArray; break;
+        default: break;
+      }
+
+      if (bound == nullptr) {
+        _stats.issued++;
+      }
+      else if (!change(*bound, id)) {
+        return;
+      }
+
+      setActiveUnit(unit);
+      glBindTexture(target, id);
+    }
+
+    void setEnabled(GLenum cap, bool enabled) {
+      GLuint *current = capability(cap);
+      if (current == nullptr) {
+        _stats.issued++;
+      }
+      else if (!change(*current, enabled ? GL_TRUE : GL_FALSE)) {
+        return;
+      }
+
+      if (enabled) {
+        glEnable(cap);
+      }
+      else {
+        glDisable(cap);
+      }
+    }
+
+    void enable(GLenum cap) {
+      setEnabled(cap, true);
+    }
+
+    void disable(GLenum cap) {
+      setEnabled(cap, false);
+    }
+
+    void setBlendEquation(GLenum mode) {
+      if (change(blendEquation, mode)) {
+        glBlendEquation(mode);
+      }
+    }
+
+    void setBlendFunc(GLenum src, GLenum dst) {
+      if (blendSrc == src && blendDst == dst) {
+        _stats.avoided++;
+        return;
+      }
+
+      blendSrc = src;
+      blendDst = dst;
+      _stats.issued++;
+
+      glBlendFunc(src, dst);
+    }
+
+    void setDepthFunc(GLenum func) {
+      if (change(depthFunc, func)) {
+        glDepthFunc(func);
+      }
+    }
+
+    void setDepthMask(bool write) {
+      if (change(depthMask, write ? GL_TRUE : GL_FALSE)) {
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+      }
+    }
+
+    /* All channels or none, a depth-only pass is the only user */
+    void setColorMask(bool write) {
+      if (change(colorMask, write ? GL_TRUE : GL_FALSE)) {
+        GLboolean w = write ? GL_TRUE : GL_FALSE;
+        glColorMask(w, w, w, w);
+      }
+    }
+
+    /*
+     * GL_NEGATIVE_ONE_TO_ONE or GL_ZERO_TO_ONE, needs GL 4.5 or
+     * ARB_clip_control. Reverse-Z wants the latter, it keeps the depth
+     * values out of the [-1, 1] remapping that would round them.
+     */
+    void setClipDepth(GLenum mode) {
+      if (change(clipDepth, mode)) {
+        glClipControl(GL_LOWER_LEFT, mode);
+      }
+    }
+};
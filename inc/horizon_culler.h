@@ -0,0 +1,274 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+/*
+ * Occlusion culling for a heightfield seen from above it, on the CPU. The
+ * view around the camera is split into angular sectors and every sector
+ * keeps its horizon: the highest elevation, as height over horizontal
+ * distance, of the terrain known to cover it so far. Walking outward from
+ * the camera, anything whose top stays below the horizon of every sector
+ * it spans is hidden.
+ *
+ * The walk descends a min/max pyramid of the patch heights and visits the
+ * children of a node starting with the quadrant the camera is in. Like a
+ * BSP walk, that is front to back along every ray from the camera: a node
+ * is only reached after everything that could stand in front of it. A node
+ * under the horizon is hidden with everything in it, so the far side of a
+ * ridge costs a few coarse nodes instead of all its patches.
+ *
+ * Visible patches raise the horizon by their lowest point, and only in the
+ * sectors they cover completely, so the result is conservative. Every ray
+ * through such a sector crosses the patch before it reaches anything the
+ * walk visits later, so the horizon can be raised right away.
+ */
+class HorizonCuller {
+  public:
+    /* A power of two, sector indices wrap with a mask */
+    static const int Sectors = 1024;
+
+  private:
+    int patches;
+    float quads;
+
+    /* Nodes per side and the height range of every node, per level */
+    std::vector<int> sizes;
+    std::vector<std::vector<float>> minLevels, maxLevels;
+
+    std::vector<float> horizon;
+    std::vector<uint8_t> _hidden;
+
+    /* The terrain space box of a node */
+    void bounds(int level, int x, int y, glm::vec3 &lo, glm::vec3 &hi) const {
+      int span = 1 << level;
+      int size = sizes[level];
+
+      lo = { x * span * quads, y * span * quads, minLevels[level][y * size + x] };
+      hi = {
+        std::min((x + 1) * span, patches) * quads,
+        std::min((y + 1) * span, patches) * quads,
+        maxLevels[level][y * size + x]
+      };
+    }
+
+    /* Squared horizontal distances from c to the nearest and farthest point of the box */
+    static float nearest2(const glm::vec2 &c, const glm::vec3 &lo, const glm::vec3 &hi) {
+      float dx = std::max(std::max(lo.x - c.x, c.x - hi.x), 0.0f);
+      float dy = std::max(std::max(lo.y - c.y, c.y - hi.y), 0.0f);
+      return dx * dx + dy * dy;
+    }
+
+    static float farthest2(const glm::vec2 &c, const glm::vec3 &lo, const glm::vec3 &hi) {
+      float fx = std::max(std::abs(lo.x - c.x), std::abs(hi.x - c.x));
+      float fy = std::max(std::abs(lo.y - c.y), std::abs(hi.y - c.y));
+      return fx * fx + fy * fy;
+    }
+
+    /* std::floor is a libm call without SSE 4.1 */
+    static int floorInt(float f) {
+      int i = (int) f;
+      return f < i ? i - 1 : i;
+    }
+
+    /*
+     * Direction of (x, y) as a "diamond angle" in [0, 4): it grows with the
+     * real angle, which is all the sectors need, without an atan2
+     */
+    static float direction(float x, float y) {
+      float d = std::abs(x) + std::abs(y);
+      if (d <= 0.0f) {
+        return 0.0f;
+      }
+
+      float t = y / d;
+      if (x >= 0.0f) {
+        return y >= 0.0f ? t : 4.0f + t;
+      }
+      return 2.0f - t;
+    }
+
+    /*
+     * Angular extent of a box the camera is outside of, in sector units.
+     * Only two corners bound it, the ones on the silhouette seen from c.
+     * `to` may pass Sectors when the box straddles direction 0.
+     */
+    static void extent(const glm::vec2 &c, const glm::vec3 &lo, const glm::vec3 &hi, float &from, float &to) {
+      /* Sides of the box nearest to and farthest from the camera */
+      float nearX = c.x < lo.x ? lo.x : hi.x, farX = c.x < lo.x ? hi.x : lo.x;
+      float nearY = c.y < lo.y ? lo.y : hi.y, farY = c.y < lo.y ? hi.y : lo.y;
+
+      bool besideX = c.x < lo.x || c.x > hi.x;
+      bool besideY = c.y < lo.y || c.y > hi.y;
+
+      float a, b;
+      if (besideX && besideY) {
+        a = direction(nearX - c.x, farY - c.y);
+        b = direction(farX - c.x, nearY - c.y);
+      }
+      else if (besideX) {
+        a = direction(nearX - c.x, lo.y - c.y);
+        b = direction(nearX - c.x, hi.y - c.y);
+      }
+      else {
+        a = direction(lo.x - c.x, nearY - c.y);
+        b = direction(hi.x - c.x, nearY - c.y);
+      }
+
+      if (a > b) {
+        std::swap(a, b);
+      }
+
+      /* A box the camera is outside of spans less than half a turn */
+      if (b - a > 2.0f) {
+        std::swap(a, b);
+        b += 4.0f;
+      }
+
+      from = a / 4.0f * Sectors;
+      to   = b / 4.0f * Sectors;
+    }
+
+    float & sector(int s) {
+      return horizon[s & (Sectors - 1)];
+    }
+
+    /* Lowest elevation of a height over a range of horizontal distances */
+    static float lowest(float dz, float nearest, float farthest) {
+      return dz >= 0.0f ? dz / farthest : dz / nearest;
+    }
+
+    static float highest(float dz, float nearest, float farthest) {
+      return dz >= 0.0f ? dz / nearest : dz / farthest;
+    }
+
+    void hide(int level, int x, int y) {
+      int span = 1 << level;
+      int x1 = std::min((x + 1) * span, patches);
+      int y1 = std::min((y + 1) * span, patches);
+
+      for (int py = y * span; py < y1; py++) {
+        std::fill(&_hidden[py * patches + x * span], &_hidden[py * patches + x1], 1);
+      }
+    }
+
+    template <typename F>
+    void walk(const glm::vec3 &camera, int level, int x, int y, F &inFrustum) {
+      glm::vec3 lo, hi;
+      bounds(level, x, y, lo, hi);
+
+      if (!inFrustum(lo, hi)) {
+        return;
+      }
+
+      const glm::vec2 c { camera.x, camera.y };
+      float n2 = nearest2(c, lo, hi);
+
+      /* Around the camera nothing is hidden, only descend */
+      if (n2 > 0.0f) {
+        float nearest  = std::sqrt(n2);
+        float farthest = std::sqrt(farthest2(c, lo, hi));
+
+        float from, to;
+        extent(c, lo, hi, from, to);
+
+        float top = highest(hi.z - camera.z, nearest, farthest);
+        bool below = true;
+        for (int s = floorInt(from); s <= floorInt(to) && below; s++) {
+          below = sector(s) >= top;
+        }
+
+        if (below) {
+          hide(level, x, y);
+          return;
+        }
+
+        /* A visible patch, its ground hides what lies beyond it */
+        if (level == 0) {
+          float elevation = lowest(lo.z - camera.z, nearest, farthest);
+          for (int s = -floorInt(-from); s < floorInt(to); s++) {
+            float &h = sector(s);
+            h = std::max(h, elevation);
+          }
+          return;
+        }
+      }
+
+      if (level == 0) {
+        return;
+      }
+
+      /* The child quadrant holding the camera first, the opposite one last */
+      int child = level - 1;
+      int size  = sizes[child];
+      int span  = 1 << child;
+
+      int nearX = c.x < (2 * x + 1) * span * quads ? 0 : 1;
+      int nearY = c.y < (2 * y + 1) * span * quads ? 0 : 1;
+
+      for (int i = 0; i < 4; i++) {
+        int cx = 2 * x + (nearX ^ (i & 1));
+        int cy = 2 * y + (nearY ^ (i >> 1));
+
+        if (cx < size && cy < size) {
+          walk(camera, child, cx, cy, inFrustum);
+        }
+      }
+    }
+
+  public:
+    HorizonCuller(const std::vector<float> &minHeights, const std::vector<float> &maxHeights, int patches, float quads)
+      : patches { patches }
+      , quads { quads }
+      , horizon(Sectors)
+      , _hidden(patches * patches)
+    {
+      sizes.push_back(patches);
+      minLevels.push_back(minHeights);
+      maxLevels.push_back(maxHeights);
+
+      while (sizes.back() > 1) {
+        int below = sizes.back();
+        int size = (below + 1) / 2;
+
+        const std::vector<float> &minBelow = minLevels.back();
+        const std::vector<float> &maxBelow = maxLevels.back();
+        std::vector<float> mins(size * size, FLT_MAX), maxs(size * size, -FLT_MAX);
+
+        for (int y = 0; y < below; y++) {
+          for (int x = 0; x < below; x++) {
+            int i = (y / 2) * size + x / 2;
+            mins[i] = std::min(mins[i], minBelow[y * below + x]);
+            maxs[i] = std::max(maxs[i], maxBelow[y * below + x]);
+          }
+        }
+
+        sizes.push_back(size);
+        minLevels.push_back(std::move(mins));
+        maxLevels.push_back(std::move(maxs));
+      }
+    }
+
+    /* Whether the last cull() found the patch hidden */
+    bool hidden(int patch) const {
+      return _hidden[patch] != 0;
+    }
+
+    /*
+     * Finds the hidden patches for a camera in terrain space. Nodes
+     * inFrustum(lo, hi) rejects are skipped, nothing outside the view can
+     * hide what is inside it.
+     */
+    template <typename F>
+    void cull(const glm::vec3 &camera, F inFrustum) {
+      std::fill(horizon.begin(), horizon.end(), -FLT_MAX);
+      std::fill(_hidden.begin(), _hidden.end(), 0);
+
+      walk(camera, (int) sizes.size() - 1, 0, 0, inFrustum);
+    }
+};
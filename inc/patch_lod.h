@@ -0,0 +1,56 @@
+#pragma once
+
+#include <algorithm>
+#include <cfloat>
+
+/*
+ * How Terrain picks the LOD of a patch and the distances it morphs over,
+ * apart from GL so bench/seam_check.cpp can run it on the CPU.
+ *
+ * A patch at distance d (to its bounding box) takes the finest LOD whose
+ * range lodDistance * 2^lod lies beyond d, and outline.vert morphs its odd
+ * vertices onto the next coarser grid by the distance of each vertex. Two
+ * neighbours meet without cracks when, along their shared edge, the finer
+ * one has morphed all the way and the coarser one not at all:
+ *
+ *  - The finer patch ends its morph at the end of its range, and the shared
+ *    edge lies in the coarser patch, which is beyond that end.
+ *  - A vertex of the finer patch is at most its distance plus the patch
+ *    diagonal away, so the coarser patch starts its morph no closer than the
+ *    end of the finer range plus the diagonal.
+ *
+ * `diagonal` is the largest 3D diagonal of a patch box, with its height
+ * range, and the morph has to fit in between: that is what minDistance()
+ * keeps room for. It also keeps neighbours within one LOD of each other.
+ */
+class PatchLod {
+  public:
+    /* Smallest lodDistance the seams stay closed with */
+    static float minDistance(float diagonal) {
+      return 2.5f * diagonal;
+    }
+
+    /* The finest LOD whose range holds a patch `d` away */
+    static int select(float d, float lodDistance, int lods) {
+      int lod = 0;
+      while (lod < lods - 1 && d >= lodDistance * (1 << lod)) {
+        lod++;
+      }
+      return lod;
+    }
+
+    /*
+     * Distances a patch at `lod` morphs over, the last 30 % of its range
+     * where the diagonal leaves room. The coarsest LOD has nothing to morph to.
+     */
+    static void morph(int lod, float lodDistance, float diagonal, int lods, float &start, float &end) {
+      if (lod == lods - 1) {
+        start = FLT_MAX / 2.0f;
+        end   = FLT_MAX;
+        return;
+      }
+
+      end   = lodDistance * (1 << lod);
+      start = std::max(0.7f * end, 0.5f * end + diagonal);
+    }
+};
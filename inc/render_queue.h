@@ -0,0 +1,195 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "gl_state.h"
+
+/*
+ * Collects the draws of a frame and runs them in the order of a 64-bit
+ * sort key instead of the order they were submitted in:
+ *
+ *   63..60 pass, 59..48 program, 47..32 texture set, 31..0 depth
+ *
+ * Draws of a pass are grouped by program and then by texture set, so each
+ * is switched as rarely as possible. Opaque draws go front to back within
+ * a group, transparent ones back to front. The keys are radix sorted, which
+ * costs the same few passes over the items however the frame is made up.
+ *
+ * A texture set is a function binding a fixed group of textures, registered
+ * once with addTextureSet(). It only runs when the set changes between two
+ * draws. Draws submitted with NoTextures may bind textures of their own.
+ */
+class RenderQueue {
+  public:
+    enum Pass {
+      DepthPrepass = 0,
+      Opaque       = 1,
+      Occlusion    = 2,
+      Transparent  = 3,
+      Overlay      = 4,
+    };
+
+    static const int NoTextures = -1;
+
+    struct Stats {
+      int items;
+      int programChanges;
+      int textureSetChanges;
+    };
+
+  private:
+    struct Item {
+      GLuint program;
+      int textureSet;
+      std::function<void()> draw;
+    };
+
+    struct Entry {
+      uint64_t key;
+      uint32_t item;
+    };
+
+    std::vector<Item> items;
+    std::vector<Entry> entries, scratch;
+
+    std::vector<std::function<void()>> textureSets;
+    std::vector<GLuint> programs;
+
+    Stats _stats;
+
+    /* Dense program indices keep distinct programs apart within 12 bits */
+    uint64_t programIndex(GLuint program) {
+      if (program == 0) {
+        return 0;
+      }
+
+      for (size_t i = 0; i < programs.size(); i++) {
+        if (programs[i] == program) {
+          return i + 1;
+        }
+      }
+
+      if (programs.size() + 1 >= (1 << 12)) {
+        throw std::length_error { "Too many programs in the render queue" };
+      }
+
+      programs.push_back(program);
+      return programs.size();
+    }
+
+    /* Non-negative floats order like their bits */
+    static uint64_t depthBits(float depth, bool backToFront) {
+      uint32_t bits = 0;
+      if (depth > 0.0f) {
+        std::memcpy(&bits, &depth, sizeof(bits));
+      }
+
+      return backToFront ? ~bits : bits;
+    }
+
+    /* LSD radix sort on bytes, stable, bytes every key shares are skipped */
+    void sort() {
+      size_t n = entries.size();
+      scratch.resize(n);
+
+      for (int shift = 0; shift < 64; shift += 8) {
+        size_t counts[256] = { };
+        for (const Entry &e : entries) {
+          counts[(e.key >> shift) & 0xff]++;
+        }
+
+        if (counts[(entries[0].key >> shift) & 0xff] == n) {
+          continue;
+        }
+
+        size_t offset = 0;
+        for (size_t &count : counts) {
+          size_t c = count;
+          count = offset;
+          offset += c;
+        }
+
+        for (const Entry &e : entries) {
+          scratch[counts[(e.key >> shift) & 0xff]++] = e;
+        }
+
+        entries.swap(scratch);
+      }
+    }
+
+  public:
+    const Stats &stats;
+
+    RenderQueue()
+      : _stats { 0, 0, 0 }
+      , stats { _stats }
+    { }
+
+    RenderQueue(const RenderQueue &) = delete;
+    RenderQueue & operator=(const RenderQueue &) = delete;
+
+    int addTextureSet(std::function<void()> bind) {
+      if (textureSets.size() + 1 >= (1 << 16)) {
+        throw std::length_error { "Too many texture sets in the render queue" };
+      }
+
+      textureSets.push_back(std::move(bind));
+      return (int) textureSets.size() - 1;
+    }
+
+    /*
+     * Queues a draw. `program` is put in use before it, 0 leaves the
+     * program alone. `depth` is the view distance used to order the draws
+     * within their program and texture set, negative values count as 0.
+     */
+    void submit(Pass pass, GLuint program, int textureSet, float depth, std::function<void()> draw) {
+      uint64_t key =
+        ((uint64_t) pass                          << 60) |
+        (programIndex(program)                    << 48) |
+        ((uint64_t) (uint16_t) (textureSet + 1)   << 32) |
+        depthBits(depth, pass == Transparent);
+
+      entries.push_back({ key, (uint32_t) items.size() });
+      items.push_back({ program, textureSet, std::move(draw) });
+    }
+
+    /* Sorts and runs the queued draws, then empties the queue */
+    void execute() {
+      _stats = { (int) items.size(), 0, 0 };
+
+      if (items.empty()) {
+        return;
+      }
+
+      sort();
+
+      GLState &state = GLState::current();
+      int textureSet = NoTextures;
+
+      for (const Entry &e : entries) {
+        Item &item = items[e.item];
+
+        if (item.program != 0 && item.program != state.currentProgram()) {
+          state.useProgram(item.program);
+          _stats.programChanges++;
+        }
+
+        if (item.textureSet != NoTextures && item.textureSet != textureSet) {
+          textureSets[item.textureSet]();
+          _stats.textureSetChanges++;
+        }
+        textureSet = item.textureSet;
+
+        item.draw();
+      }
+
+      items.clear();
+      entries.clear();
+    }
+};
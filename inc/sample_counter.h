@@ -0,0 +1,80 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include "stream_buffer.h"
+
+/*
+ * Counts the samples that pass the depth test between begin() and end(),
+ * with a GL_SAMPLES_PASSED query. There is one query per frame in flight,
+ * so result() reports the newest count the GPU has finished and reading it
+ * never waits for the frame being drawn.
+ */
+class SampleCounter {
+  public:
+    static const int Frames = StreamBuffer::Frames;
+
+  private:
+    GLuint queries[Frames];
+    bool pending[Frames];
+    int frame;
+    GLuint64 count;
+
+    void read(int i, bool wait) {
+      if (!wait) {
+        GLuint available;
+        glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+          return;
+        }
+      }
+
+      glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &count);
+      pending[i] = false;
+    }
+
+  public:
+    SampleCounter()
+      : pending { }
+      , frame { 0 }
+      , count { 0 }
+    {
+      glGenQueries(Frames, queries);
+    }
+
+    SampleCounter(const SampleCounter &) = delete;
+    SampleCounter & operator=(const SampleCounter &) = delete;
+
+    ~SampleCounter() {
+      glDeleteQueries(Frames, queries);
+    }
+
+    void begin() {
+      /* Frames old, this only waits if the GPU is that far behind */
+      if (pending[frame]) {
+        read(frame, true);
+      }
+
+      glBeginQuery(GL_SAMPLES_PASSED, queries[frame]);
+    }
+
+    void end() {
+      glEndQuery(GL_SAMPLES_PASSED);
+
+      pending[frame] = true;
+      frame = (frame + 1) % Frames;
+    }
+
+    /* Samples counted by the newest finished query */
+    GLuint64 result() {
+      /* Oldest first, so the newest available count is kept */
+      for (int k = 0; k < Frames; k++) {
+        int i = (frame + k) % Frames;
+        if (pending[i]) {
+          read(i, false);
+        }
+      }
+
+      return count;
+    }
+};
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "gl_state.h"
+
+/*
+ * Places a material layer where the terrain lies within a height and slope
+ * band. Heights are the heightmap values in [0, 1], slopes are 1 - n.z of
+ * the surface normal, 0 for flat ground and 1 for a vertical cliff. The
+ * weight fades out linearly over `fade` outside the band.
+ */
+struct SplatRule {
+  int   layer;
+  float minHeight, maxHeight;
+  float minSlope,  maxSlope;
+  float fade;
+};
+
+/*
+ * Auto-splatting computed once on the CPU from the heightmap. Every texel
+ * keeps only its 4 heaviest material layers, as two textures the fragment
+ * shader reads: the layer indices (RGBA8UI) and their weights (RGBA8,
+ * summing to 1, heaviest first). Shading then costs at most 4 material
+ * fetches however many layers the TextureArray holds.
+ *
+ * Both textures use nearest filtering, interpolated weights would belong
+ * to the layers of a neighbouring texel.
+ */
+class SplatMap {
+  public:
+    static const int Fetches = 4;
+
+  private:
+    GLuint indexId, weightId;
+    GLint _indexUnit, _weightUnit;
+    int _w, _h;
+
+    static float band(float v, float lo, float hi, float fade) {
+      if (fade <= 0.0f) {
+        return v >= lo && v <= hi ? 1.0f : 0.0f;
+      }
+
+      float below = std::min(std::max((v - lo) / fade + 1.0f, 0.0f), 1.0f);
+      float above = std::min(std::max((hi - v) / fade + 1.0f, 0.0f), 1.0f);
+
+      return below * above;
+    }
+
+    static GLuint createTexture(GLint format, GLenum layout, const uint8_t *data, int w, int h) {
+      GLuint id;
+      glGenTextures(1, &id);
+
+      glBindTexture(GL_TEXTURE_2D, id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glTexImage2D(GL_TEXTURE_2D, 0, format, w, h, 0, layout, GL_UNSIGNED_BYTE, data);
+      glBindTexture(GL_TEXTURE_2D, 0);
+
+      return id;
+    }
+
+  public:
+    const int &width;
+    const int &height;
+
+    /*
+     * `heights` holds RGB pixels, the blue channel is the height like in
+     * outline.vert. `heightScale` is the height of a full-range value
+     * measured in texels, so slopes come out right for the drawn terrain.
+     */
+    SplatMap(const std::vector<uint8_t> &heights, int w, int h, float heightScale,
+             const std::vector<SplatRule> &rules)
+      : width  { _w }
+      , height { _h }
+      , _indexUnit { -1 }
+      , _weightUnit { -1 }
+      , _w { w }
+      , _h { h }
+    {
+      if (rules.empty()) {
+        throw std::invalid_argument { "Splat map needs at least one rule" };
+      }
+
+      int layers = 0;
+      for (const SplatRule &rule : rules) {
+        if (rule.layer < 0 || rule.layer > 255) {
+          throw std::invalid_argument { "Splat layers must be in [0, 255]" };
+        }
+        layers = std::max(layers, rule.layer + 1);
+      }
+
+      auto heightAt = [&](int x, int y) {
+        x = std::min(std::max(x, 0), _w - 1);
+        y = std::min(std::max(y, 0), _h - 1);
+        return heights[(y * _w + x) * 3 + 2] / 255.0f;
+      };
+
+      std::vector<uint8_t> indices(_w * _h * 4);
+      std::vector<uint8_t> weights(_w * _h * 4);
+      std::vector<float> layerWeights(layers);
+
+      for (int y = 0; y < _h; y++) {
+        for (int x = 0; x < _w; x++) {
+          float value = heightAt(x, y);
+
+          /* Central differences give the normal, 1 - n.z the slope */
+          float dx = (heightAt(x + 1, y) - heightAt(x - 1, y)) * 0.5f * heightScale;
+          float dy = (heightAt(x, y + 1) - heightAt(x, y - 1)) * 0.5f * heightScale;
+          float slope = 1.0f - 1.0f / std::sqrt(dx * dx + dy * dy + 1.0f);
+
+          std::fill(layerWeights.begin(), layerWeights.end(), 0.0f);
+          for (const SplatRule &rule : rules) {
+            layerWeights[rule.layer] +=
+              band(value, rule.minHeight, rule.maxHeight, rule.fade) *
+              band(slope, rule.minSlope,  rule.maxSlope,  rule.fade);
+          }
+
+          /* Keep the heaviest layers, sorted so the shader can stop early */
+          std::array<int, Fetches> top;
+          std::array<float, Fetches> topWeight;
+          top.fill(rules[0].layer);
+          topWeight.fill(0.0f);
+
+          for (int l = 0; l < layers; l++) {
+            float weight = layerWeights[l];
+            if (weight <= topWeight[Fetches - 1]) {
+              continue;
+            }
+
+            int i = Fetches - 1;
+            for (; i > 0 && weight > topWeight[i - 1]; i--) {
+              top[i] = top[i - 1];
+              topWeight[i] = topWeight[i - 1];
+            }
+            top[i] = l;
+            topWeight[i] = weight;
+          }
+
+          /* Texels no rule covers fall back to the first rule's layer */
+          float total = topWeight[0] + topWeight[1] + topWeight[2] + topWeight[3];
+          if (total <= 0.0f) {
+            topWeight[0] = total = 1.0f;
+          }
+
+          /* Quantized weights sum to exactly 255, the rounding goes to the heaviest */
+          uint8_t *index  = &indices[(y * _w + x) * 4];
+          uint8_t *weight = &weights[(y * _w + x) * 4];
+          int sum = 0;
+          for (int i = 1; i < Fetches; i++) {
+            index[i]  = (uint8_t) top[i];
+            weight[i] = (uint8_t) std::lround(topWeight[i] / total * 255.0f);
+            sum += weight[i];
+          }
+          index[0]  = (uint8_t) top[0];
+          weight[0] = (uint8_t) (255 - sum);
+        }
+      }
+
+      GLint alignment;
+      glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+      indexId  = createTexture(GL_RGBA8UI, GL_RGBA_INTEGER, indices.data(), _w, _h);
+      weightId = createTexture(GL_RGBA8,   GL_RGBA,         weights.data(), _w, _h);
+
+      glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+    }
+
+    SplatMap(const SplatMap &) = delete;
+    SplatMap & operator=(const SplatMap &) = delete;
+
+    ~SplatMap() {
+      glDeleteTextures(1, &indexId);
+      glDeleteTextures(1, &weightId);
+    }
+
+    /* Units the index and weight textures are bound to, for the samplers */
+    GLint indexUnit() const {
+      return _indexUnit;
+    }
+
+    GLint weightUnit() const {
+      return _weightUnit;
+    }
+
+    void bind(GLint indexUnit, GLint weightUnit) {
+      _indexUnit  = indexUnit;
+      _weightUnit = weightUnit;
+
+      GLState &state = GLState::current();
+      state.bindTexture(_indexUnit,  GL_TEXTURE_2D, indexId);
+      state.bindTexture(_weightUnit, GL_TEXTURE_2D, weightId);
+    }
+
+    void unbind() {
+      GLState &state = GLState::current();
+      state.bindTexture(_indexUnit,  GL_TEXTURE_2D, 0);
+      state.bindTexture(_weightUnit, GL_TEXTURE_2D, 0);
+
+      _indexUnit = _weightUnit = -1;
+    }
+};
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <GL/glew.h>
+
+/*
+ * Ring buffer for the data streamed to the GPU every frame: ImGui vertices
+ * and indices, terrain instances and draw commands, uniform blocks. It is
+ * split into one region per frame in flight; each frame suballocates from
+ * its region and endFrame() fences it, so the CPU only ever writes a
+ * region the GPU has finished reading. Nothing is reallocated by the
+ * driver once the buffer exists.
+ *
+ * With GL 4.4 or ARB_buffer_storage the buffer stays persistently mapped.
+ * Otherwise every map() maps its range unsynchronized, which is safe for
+ * the same reason: the fences already keep the GPU out of the region.
+ *
+ * The buffer can be bound to any target. Offsets are handed out by map()
+ * and write(), attribute pointers and draw calls take them as usual.
+ */
+class StreamBuffer {
+  public:
+    static const int Frames = 3;
+
+  private:
+    GLuint id;
+    GLsizeiptr frameSize;
+    bool persistent;
+    uint8_t *mapped;
+
+    int frame;
+    GLsizeiptr head;
+    GLsync fences[Frames];
+
+  public:
+    StreamBuffer(GLsizeiptr frameSize = 4 << 20)
+      : frameSize { frameSize }
+      , persistent { GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage }
+      , mapped { nullptr }
+      , frame { 0 }
+      , head { 0 }
+      , fences { }
+    {
+      glGenBuffers(1, &id);
+
+      /* The copy target leaves the vertex array and draw bindings alone */
+      glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+
+      if (persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+        glBufferStorage(GL_COPY_WRITE_BUFFER, Frames * frameSize, nullptr, flags);
+        mapped = (uint8_t *) glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, Frames * frameSize, flags);
+
+        if (mapped == nullptr) {
+          glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+          glDeleteBuffers(1, &id);
+
+          throw std::runtime_error { "Could not map the stream buffer persistently" };
+        }
+      }
+      else {
+        glBufferData(GL_COPY_WRITE_BUFFER, Frames * frameSize, nullptr, GL_STREAM_DRAW);
+      }
+
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    StreamBuffer(const StreamBuffer &) = delete;
+    StreamBuffer & operator=(const StreamBuffer &) = delete;
+
+    ~StreamBuffer() {
+      for (GLsync fence : fences) {
+        if (fence != nullptr) {
+          glDeleteSync(fence);
+        }
+      }
+
+      if (persistent) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+      }
+
+      glDeleteBuffers(1, &id);
+    }
+
+    operator GLuint() const {
+      return id;
+    }
+
+    bool isPersistent() const {
+      return persistent;
+    }
+
+    /* Bytes handed out in the current frame */
+    GLsizeiptr used() const {
+      return head;
+    }
+
+    /* Alignment map() needs for ranges bound with glBindBufferRange(GL_UNIFORM_BUFFER, ...) */
+    static GLint uniformAlignment() {
+      GLint alignment;
+      glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+      return alignment;
+    }
+
+    /*
+     * Reserves `size` bytes of this frame's region, aligned to `alignment`
+     * bytes from the start of the buffer. Returns where to write them and
+     * stores their buffer offset in `offset`. Call unmap() before drawing.
+     */
+    void * map(GLsizeiptr size, GLsizeiptr alignment, GLintptr &offset) {
+      GLsizeiptr base = frame * frameSize;
+      GLsizeiptr start = (base + head + alignment - 1) / alignment * alignment - base;
+
+      if (start + size > frameSize) {
+        throw std::length_error {
+          "Stream buffer frame of " + std::to_string(frameSize) + " bytes is full"
+        };
+      }
+
+      head = start + size;
+      offset = base + start;
+
+      if (persistent) {
+        return mapped + offset;
+      }
+
+      glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+      void *data = glMapBufferRange(
+        GL_COPY_WRITE_BUFFER, offset, size,
+        GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT
+      );
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+      if (data == nullptr) {
+        throw std::runtime_error { "Could not map the stream buffer" };
+      }
+
+      return data;
+    }
+
+    /* Ends the write of the last map() */
+    void unmap() {
+      if (persistent) {
+        return;
+      }
+
+      glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+      glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    /* Copies `data` into this frame's region and returns its buffer offset */
+    GLintptr write(const void *data, GLsizeiptr size, GLsizeiptr alignment = 4) {
+      GLintptr offset;
+      std::memcpy(map(size, alignment, offset), data, size);
+      unmap();
+
+      return offset;
+    }
+
+    /*
+     * Fences the commands that read this frame's region and moves on to
+     * the next one, waiting until the GPU has finished with it.
+     */
+    void endFrame() {
+      fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+      frame = (frame + 1) % Frames;
+      head = 0;
+
+      GLsync &fence = fences[frame];
+      if (fence == nullptr) {
+        return;
+      }
+
+      GLenum status;
+      do {
+        status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+      } while (status == GL_TIMEOUT_EXPIRED);
+
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+};
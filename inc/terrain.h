@@ -0,0 +1,565 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+#include "horizon_culler.h"
+#include "patch_lod.h"
+#include "stream_buffer.h"
+
+/*
+ * The heightmap terrain split into square patches. Every patch draws the
+ * same (quads + 1)^2 vertex grid; each LOD is a range of the shared index
+ * buffer that skips every other vertex of the finer one. update() culls
+ * the patches against the view frustum, picks their LODs by distance and
+ * writes the visible ones, sorted by LOD and front to back within a LOD,
+ * into this frame's region of the StreamBuffer. LODs grow with distance,
+ * so the whole list runs roughly front to back and the depth test rejects
+ * most hidden fragments before they are shaded. draw() then renders each
+ * LOD with one glDrawElementsInstanced, so the number of draw calls does
+ * not grow with the map.
+ *
+ * Where the driver has glMultiDrawElementsIndirect (GL 4.3, or the
+ * multi_draw_indirect and base_instance extensions), update() also writes
+ * a draw command per LOD into a GL_DRAW_INDIRECT_BUFFER and draw() submits
+ * all LODs with one call, the base instance selecting each LOD's patches.
+ *
+ * With occlusionCulling on, testOcclusion() draws the bounding box of every
+ * patch in the frustum against the finished depth buffer, each inside its
+ * own GL_ANY_SAMPLES_PASSED query. update() skips the patches whose last
+ * finished query saw no samples. Results are only read once available, so
+ * they are usually a frame old and a patch coming out from behind a ridge
+ * may show up a frame late. Conditional rendering does not fit here, all
+ * patches of a LOD are drawn by one instanced call.
+ *
+ * horizonCulling is a cheaper test on the CPU, see HorizonCuller. It runs
+ * in update() before the occlusion queries and needs no results from the
+ * GPU, so it has no delay.
+ *
+ * outline.vert places the vertices: it morphs the odd vertices of a
+ * patch onto the next coarser grid over the instance's morph range.
+ * PatchLod picks the LODs and the ranges so that neighbouring patches of
+ * different LODs meet without cracks.
+ */
+class Terrain {
+  public:
+    /* Per-instance vertex attributes, see outline.vert */
+    struct Instance {
+      float x, y;
+      float size;
+      float lod;
+      float morphStart, morphEnd;
+    };
+
+    struct Stats {
+      int visible;
+      int drawCalls;
+      int occluded;
+      int queries;
+      int horizonCulled;
+    };
+
+    /* Laid out as GL expects in GL_DRAW_INDIRECT_BUFFER */
+    struct DrawCommand {
+      GLuint count;
+      GLuint instanceCount;
+      GLuint firstIndex;
+      GLint  baseVertex;
+      GLuint baseInstance;
+    };
+
+  private:
+    GLuint vao;
+    GLuint vbo, ebo;
+    bool multiDrawSupported;
+
+    /* Instances and draw commands are streamed every frame */
+    StreamBuffer &stream;
+    GLintptr instanceOffset, commandOffset;
+
+    int quads;
+    int patches;
+    int lods;
+
+    /* Height range of every patch, for culling and LOD distances */
+    std::vector<float> minHeights, maxHeights;
+
+    /* Largest 3D diagonal of a patch box, see PatchLod */
+    float diagonal;
+
+    /* Index range of every LOD in ebo */
+    std::vector<GLsizei> lodFirst, lodCount;
+
+    /* A visible patch and its distance to the camera, for sorting */
+    struct Visible {
+      float distance;
+      Instance instance;
+    };
+
+    /* Visible patches of the current frame, sorted by LOD and distance */
+    std::vector<Instance> instances;
+    std::vector<GLsizei> instanceFirst, instanceCount;
+    std::vector<DrawCommand> commands;
+
+    /* Unit cube drawn for the occlusion queries, and one query per patch */
+    GLuint boxVao, boxVbo, boxEbo;
+    std::vector<GLuint> queries;
+    std::vector<uint8_t> queryPending, occluded;
+
+    std::unique_ptr<HorizonCuller> horizon;
+
+    /* Patches in the frustum this frame, close ones are never queried */
+    std::vector<int> tested;
+
+    Stats _stats;
+
+    /* Distance from p to the box, 0 inside */
+    static float distance(const glm::vec3 &p, const glm::vec3 &lo, const glm::vec3 &hi) {
+      glm::vec3 d = glm::max(glm::max(lo - p, p - hi), glm::vec3(0.0f));
+      return glm::length(d);
+    }
+
+    /* False if the box lies entirely outside one of the frustum planes */
+    static bool visible(const glm::vec4 planes[6], const glm::vec3 &lo, const glm::vec3 &hi) {
+      for (int i = 0; i < 6; i++) {
+        const glm::vec4 &p = planes[i];
+        glm::vec3 corner {
+          p.x >= 0.0f ? hi.x : lo.x,
+          p.y >= 0.0f ? hi.y : lo.y,
+          p.z >= 0.0f ? hi.z : lo.z,
+        };
+
+        if (p.x * corner.x + p.y * corner.y + p.z * corner.z + p.w < 0.0f) {
+          return false;
+        }
+      }
+
+      return true;
+    }
+
+  public:
+    /*
+     * Patches go out to the distance lodDistance * 2^lod at each LOD.
+     * update() keeps it at least minLodDistance(), below that the morph
+     * ranges of neighbouring LODs overlap and open cracks along the seams.
+     */
+    float lodDistance;
+
+    /* Submit with glMultiDrawElementsIndirect, if supported */
+    bool multiDraw;
+
+    /* Skip patches the last occlusion queries found hidden */
+    bool occlusionCulling;
+
+    /* Skip patches below the horizon of the terrain in front of them */
+    bool horizonCulling;
+
+    const Stats &stats;
+
+    /*
+     * `heights` holds the heightmap as RGB pixels, the blue channel is the
+     * height like in outline.vert. The terrain covers size x size units and
+     * rises up to `height`, a patch spans `quads` quads at LOD 0.
+     */
+    Terrain(StreamBuffer &stream, const std::vector<uint8_t> &heights, int w, int h,
+            float size, float height, int quads = 64, int lods = 5)
+      : stream { stream }
+      , instanceOffset { 0 }
+      , commandOffset { 0 }
+      , quads { quads }
+      , patches { (int) std::ceil(size / quads) }
+      , lods { lods }
+      , instanceFirst(lods)
+      , instanceCount(lods)
+      , _stats { 0, 0, 0, 0, 0 }
+      , lodDistance { 2.0f * quads }
+      , occlusionCulling { false }
+      , horizonCulling { false }
+      , stats { _stats }
+    {
+      if (quads < 1 || quads > 255 || (quads >> (lods - 1)) < 1 || (quads & ((1 << (lods - 1)) - 1))) {
+        throw std::invalid_argument { "Patch quads must be a multiple of 2^(lods - 1) below 256" };
+      }
+
+      /* Height range of every patch, from the texels it covers */
+      minHeights.resize(patches * patches);
+      maxHeights.resize(patches * patches);
+
+      for (int py = 0; py < patches; py++) {
+        for (int px = 0; px < patches; px++) {
+          int x0 = std::max((int) std::floor(px       * quads / size * w) - 1, 0);
+          int x1 = std::min((int) std::ceil((px + 1) * quads / size * w) + 1, w - 1);
+          int y0 = std::max((int) std::floor(py       * quads / size * h) - 1, 0);
+          int y1 = std::min((int) std::ceil((py + 1) * quads / size * h) + 1, h - 1);
+
+          uint8_t lo = 255, hi = 0;
+          for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) {
+              uint8_t v = heights[(y * w + x) * 3 + 2];
+              lo = std::min(lo, v);
+              hi = std::max(hi, v);
+            }
+          }
+
+          minHeights[py * patches + px] = lo / 255.0f * height;
+          maxHeights[py * patches + px] = hi / 255.0f * height;
+        }
+      }
+
+      float range = 0.0f;
+      for (int i = 0; i < patches * patches; i++) {
+        range = std::max(range, maxHeights[i] - minHeights[i]);
+      }
+
+      diagonal = std::sqrt(2.0f * quads * quads + range * range);
+      lodDistance = std::max(lodDistance, minLodDistance());
+
+      horizon.reset(new HorizonCuller(minHeights, maxHeights, patches, (float) quads));
+
+      /* The patch grid, in LOD 0 vertex steps */
+      std::vector<GLfloat> vertices;
+      for (int y = 0; y <= quads; y++) {
+        for (int x = 0; x <= quads; x++) {
+          vertices.insert(vertices.end(), { (GLfloat) x, (GLfloat) y });
+        }
+      }
+
+      /* Every LOD takes every 2^lod-th vertex */
+      std::vector<GLushort> indices;
+      for (int lod = 0; lod < lods; lod++) {
+        int step = 1 << lod;
+        lodFirst.push_back((GLsizei) indices.size());
+
+        for (int y = 0; y < quads; y += step) {
+          for (int x = 0; x < quads; x += step) {
+            indices.insert(indices.end(), {
+              (GLushort) ((y + 0)    * (quads + 1) + (x + 0)),
+              (GLushort) ((y + 0)    * (quads + 1) + (x + step)),
+              (GLushort) ((y + step) * (quads + 1) + (x + step)),
+              (GLushort) ((y + 0)    * (quads + 1) + (x + 0)),
+              (GLushort) ((y + step) * (quads + 1) + (x + step)),
+              (GLushort) ((y + step) * (quads + 1) + (x + 0)),
+            });
+          }
+        }
+
+        lodCount.push_back((GLsizei) indices.size() - lodFirst.back());
+      }
+
+      glGenVertexArrays(1, &vao);
+      glGenBuffers(1, &vbo);
+      glGenBuffers(1, &ebo);
+
+      glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), nullptr);
+        glEnableVertexAttribArray(0);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
+
+        /* Instance attributes, pointed at each LOD's instances in draw() */
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+        glVertexAttribDivisor(1, 1);
+        glVertexAttribDivisor(2, 1);
+      glBindVertexArray(0);
+
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+      multiDrawSupported = GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+      multiDraw = multiDrawSupported;
+
+      /* Unit cube, its corners are mixed between a patch's bounds in box.vert */
+      const GLfloat corners[] {
+        0, 0, 0,  1, 0, 0,  0, 1, 0,  1, 1, 0,
+        0, 0, 1,  1, 0, 1,  0, 1, 1,  1, 1, 1,
+      };
+      const GLubyte faces[] {
+        0, 2, 1,  1, 2, 3,  4, 5, 6,  5, 7, 6,
+        0, 1, 4,  1, 5, 4,  2, 6, 3,  3, 6, 7,
+        0, 4, 2,  2, 4, 6,  1, 3, 5,  3, 7, 5,
+      };
+
+      glGenVertexArrays(1, &boxVao);
+      glGenBuffers(1, &boxVbo);
+      glGenBuffers(1, &boxEbo);
+
+      glBindVertexArray(boxVao);
+        glBindBuffer(GL_ARRAY_BUFFER, boxVbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), nullptr);
+        glEnableVertexAttribArray(0);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, boxEbo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(faces), faces, GL_STATIC_DRAW);
+      glBindVertexArray(0);
+
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+      queries.resize(patches * patches);
+      glGenQueries((GLsizei) queries.size(), queries.data());
+      queryPending.assign(queries.size(), 0);
+      occluded.assign(queries.size(), 0);
+    }
+
+    Terrain(const Terrain &) = delete;
+    Terrain & operator=(const Terrain &) = delete;
+
+    ~Terrain() {
+      glDeleteQueries((GLsizei) queries.size(), queries.data());
+      glDeleteBuffers(1, &boxEbo);
+      glDeleteBuffers(1, &boxVbo);
+      glDeleteVertexArrays(1, &boxVao);
+
+      glDeleteBuffers(1, &ebo);
+      glDeleteBuffers(1, &vbo);
+      glDeleteVertexArrays(1, &vao);
+    }
+
+    /* Quads along a patch edge at LOD 0, for outline.vert */
+    int patchQuads() const {
+      return quads;
+    }
+
+    /* Smallest lodDistance that keeps the LOD seams closed */
+    float minLodDistance() const {
+      return PatchLod::minDistance(diagonal);
+    }
+
+    bool multiDrawIndirectSupported() const {
+      return multiDrawSupported;
+    }
+
+    /*
+     * Builds the visible patch list. `mvp` maps terrain space to clip
+     * space, `camera` is the camera position in terrain space.
+     */
+    void update(const glm::mat4 &mvp, const glm::vec3 &camera) {
+      lodDistance = std::max(lodDistance, minLodDistance());
+
+      /* Frustum planes of the terrain space, from the rows of the MVP */
+      glm::vec4 rows[4];
+      for (int i = 0; i < 4; i++) {
+        rows[i] = glm::vec4(mvp[0][i], mvp[1][i], mvp[2][i], mvp[3][i]);
+      }
+
+      glm::vec4 planes[6] {
+        rows[3] + rows[0], rows[3] - rows[0],
+        rows[3] + rows[1], rows[3] - rows[1],
+        rows[3] + rows[2], rows[3] - rows[2],
+      };
+
+      /* Take in the query results that have arrived, never waiting for one */
+      for (size_t i = 0; i < queries.size(); i++) {
+        if (!queryPending[i]) {
+          continue;
+        }
+
+        GLuint available;
+        glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+          GLuint samples;
+          glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT, &samples);
+          occluded[i] = samples == 0;
+          queryPending[i] = 0;
+        }
+      }
+
+      /* Flags from before culling was turned off would be stale */
+      if (!occlusionCulling) {
+        std::fill(occluded.begin(), occluded.end(), 0);
+      }
+
+      if (horizonCulling) {
+        horizon->cull(camera, [&](const glm::vec3 &lo, const glm::vec3 &hi) {
+          return visible(planes, lo, hi);
+        });
+      }
+
+      std::vector<std::vector<Visible>> byLod(lods);
+      int hidden = 0;
+      int belowHorizon = 0;
+      tested.clear();
+
+      for (int py = 0; py < patches; py++) {
+        for (int px = 0; px < patches; px++) {
+          int i = py * patches + px;
+          glm::vec3 lo { (float) px * quads,       (float) py * quads,       minHeights[i] };
+          glm::vec3 hi { (float) (px + 1) * quads, (float) (py + 1) * quads, maxHeights[i] };
+
+          /* Patches entering the frustum are drawn until a query hides them */
+          if (!visible(planes, lo, hi)) {
+            occluded[i] = 0;
+            continue;
+          }
+
+          if (horizonCulling && horizon->hidden(i)) {
+            occluded[i] = 0;
+            belowHorizon++;
+            continue;
+          }
+
+          /* The near plane could cut into the boxes of the closest patches */
+          float d = distance(camera, lo, hi);
+          if (d < lodDistance) {
+            occluded[i] = 0;
+          }
+          else {
+            tested.push_back(i);
+          }
+
+          if (occlusionCulling && occluded[i]) {
+            hidden++;
+            continue;
+          }
+
+          int lod = PatchLod::select(d, lodDistance, lods);
+
+          Instance instance { lo.x, lo.y, (float) quads, (float) lod, 0.0f, 0.0f };
+          PatchLod::morph(lod, lodDistance, diagonal, lods, instance.morphStart, instance.morphEnd);
+
+          byLod[lod].push_back({ d, instance });
+        }
+      }
+
+      instances.clear();
+      instanceFirst.assign(lods, 0);
+      instanceCount.assign(lods, 0);
+
+      _stats = { 0, 0, hidden, 0, belowHorizon };
+      for (int lod = 0; lod < lods; lod++) {
+        std::sort(byLod[lod].begin(), byLod[lod].end(), [](const Visible &a, const Visible &b) {
+          return a.distance < b.distance;
+        });
+
+        instanceFirst[lod] = (GLsizei) instances.size();
+        instanceCount[lod] = (GLsizei) byLod[lod].size();
+        for (const Visible &v : byLod[lod]) {
+          instances.push_back(v.instance);
+        }
+
+        _stats.visible += instanceCount[lod];
+      }
+
+      if (instances.empty()) {
+        commands.clear();
+        return;
+      }
+
+      instanceOffset = stream.write(instances.data(), instances.size() * sizeof(Instance));
+
+      if (!multiDrawSupported) {
+        return;
+      }
+
+      commands.clear();
+      for (int lod = 0; lod < lods; lod++) {
+        if (instanceCount[lod] > 0) {
+          commands.push_back({
+            (GLuint) lodCount[lod], (GLuint) instanceCount[lod],
+            (GLuint) lodFirst[lod], 0, (GLuint) instanceFirst[lod]
+          });
+        }
+      }
+
+      commandOffset = stream.write(commands.data(), commands.size() * sizeof(DrawCommand));
+    }
+
+    /* Draws the visible patches, with the terrain program in use */
+    void draw() {
+      if (instances.empty()) {
+        _stats.drawCalls = 0;
+        return;
+      }
+
+      GLState::current().bindVertexArray(vao);
+      glBindBuffer(GL_ARRAY_BUFFER, stream);
+
+      if (multiDraw && multiDrawSupported) {
+        _stats.drawCalls = 1;
+
+        /* The base instance of each command offsets the instance attributes */
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (const GLvoid *) (instanceOffset + offsetof(Instance, x)));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Instance), (const GLvoid *) (instanceOffset + offsetof(Instance, morphStart)));
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, stream);
+          glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, (const GLvoid *) commandOffset, (GLsizei) commands.size(), 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return;
+      }
+
+      /* Fallback, one instanced draw per LOD */
+      _stats.drawCalls = 0;
+      for (int lod = 0; lod < lods; lod++) {
+        if (instanceCount[lod] == 0) {
+          continue;
+        }
+
+        size_t first = instanceOffset + instanceFirst[lod] * sizeof(Instance);
+
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (const GLvoid *) (first + offsetof(Instance, x)));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Instance), (const GLvoid *) (first + offsetof(Instance, morphStart)));
+
+        glDrawElementsInstanced(
+          GL_TRIANGLES, lodCount[lod], GL_UNSIGNED_SHORT,
+          (const GLvoid *) (lodFirst[lod] * sizeof(GLushort)), instanceCount[lod]
+        );
+        _stats.drawCalls++;
+      }
+
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    /*
+     * Queries which patches in the frustum are hidden, after the terrain
+     * is drawn. The program in use transforms the unit cube, setBox(lo, hi)
+     * sets the box of the next patch in terrain space. Color and depth
+     * writes should be off.
+     */
+    template <typename F>
+    void testOcclusion(F setBox) {
+      _stats.queries = 0;
+      if (!occlusionCulling) {
+        return;
+      }
+
+      GLState::current().bindVertexArray(boxVao);
+
+      for (int i : tested) {
+        /* Still waiting for the last one */
+        if (queryPending[i]) {
+          continue;
+        }
+
+        int px = i % patches;
+        int py = i / patches;
+        setBox(
+          glm::vec3 { (float) px * quads,       (float) py * quads,       minHeights[i] },
+          glm::vec3 { (float) (px + 1) * quads, (float) (py + 1) * quads, maxHeights[i] }
+        );
+
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, queries[i]);
+          glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, nullptr);
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+
+        queryPending[i] = 1;
+        _stats.queries++;
+      }
+    }
+};
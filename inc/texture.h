@@ -0,0 +1,434 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "gl_state.h"
+
+#include <boost/filesystem.hpp>
+
+#include <SOIL.h>
+#include <stb_image_aug.h>
+
+class Texture {
+  private:
+    GLuint id;
+    GLint unit;
+    int _w, _h;
+
+    void upload(const uint8_t *image) {
+      glGenTextures(1, &id);
+
+      glBindTexture(GL_TEXTURE_2D, id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, _w, _h, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
+        glGenerateMipmap(GL_TEXTURE_2D);
+      glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    /* Uploads a DDS file baked by asset_baker, mip chain included */
+    void uploadBaked(const uint8_t *dds, size_t size) {
+      /* Mip levels of raw RGB files are not 4-byte aligned */
+      GLint alignment;
+      glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+      id = SOIL_load_OGL_texture_from_memory(dds, (int) size, SOIL_LOAD_AUTO, SOIL_CREATE_NEW_ID, SOIL_FLAG_DDS_LOAD_DIRECT);
+
+      glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
+      if (id == 0) {
+        throw std::runtime_error {
+          SOIL_last_result()
+        };
+      }
+
+      glBindTexture(GL_TEXTURE_2D, id);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH,  &_w);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &_h);
+
+        /* Levels the file brought, undefined ones report a width of 0 */
+        GLint levels = 1;
+        for (GLint w = _w, h = _h; w > 1 || h > 1; levels++) {
+          GLint width = 0;
+          glGetTexLevelParameteriv(GL_TEXTURE_2D, levels, GL_TEXTURE_WIDTH, &width);
+          if (width == 0) {
+            break;
+          }
+
+          w = std::max(w / 2, 1);
+          h = std::max(h / 2, 1);
+        }
+
+        /* Sample the baked mips, not just level 0 */
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+      glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+  public:
+    const int &width;
+    const int &height;
+
+    /* Path of the baked DDS next to an image ("res/a.jpg.dds"), or an empty string if there is none */
+    static std::string bakedPath(const std::string &path) {
+      std::string baked = path + ".dds";
+
+      boost::system::error_code ec;
+      if (!boost::filesystem::is_regular_file(baked, ec)) {
+        return { };
+      }
+
+      return baked;
+    }
+
+    /* Reads a whole file, used for the baked DDS files */
+    static std::vector<uint8_t> readFile(const std::string &path) {
+      std::ifstream file { path, std::ios::binary };
+      if (!file) {
+        throw std::runtime_error { "Could not open '" + path + "'" };
+      }
+
+      return { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+    }
+
+    /* Prefers the baked DDS file when there is one */
+    Texture(const char *path)
+      : width  { _w }
+      , height { _h }
+      , unit { -1 }
+    {
+      std::string baked = bakedPath(path);
+      if (!baked.empty()) {
+        std::vector<uint8_t> dds = readFile(baked);
+        uploadBaked(dds.data(), dds.size());
+        return;
+      }
+
+      uint8_t *image = SOIL_load_image(path, &_w, &_h, nullptr, SOIL_LOAD_RGB);
+
+      if (image == nullptr) {
+        throw std::runtime_error {
+          SOIL_last_result()
+        };
+      }
+
+      upload(image);
+
+      SOIL_free_image_data(image);
+    }
+
+    /* Uploads already decoded RGB pixels, see TextureLoader */
+    Texture(const uint8_t *image, int w, int h)
+      : width  { _w }
+      , height { _h }
+      , unit { -1 }
+      , _w { w }
+      , _h { h }
+    {
+      upload(image);
+    }
+
+    /* Uploads a baked DDS file already read into memory, see TextureLoader */
+    Texture(const std::vector<uint8_t> &dds)
+      : width  { _w }
+      , height { _h }
+      , unit { -1 }
+    {
+      uploadBaked(dds.data(), dds.size());
+    }
+
+    Texture(const Texture &) = delete;
+    Texture & operator=(const Texture &) = delete;
+
+    ~Texture() {
+      glDeleteTextures(1, &id);
+    }
+
+    operator GLuint() {
+      return id;
+    }
+
+    operator GLuint() const {
+      return id;
+    }
+
+    GLint boundUnit() const {
+      return unit;
+    }
+
+    /* Reads level 0 back as RGB, for CPU preprocessing of what was uploaded */
+    std::vector<uint8_t> pixels() const {
+      std::vector<uint8_t> data(_w * _h * 3);
+
+      GLint alignment;
+      glGetIntegerv(GL_PACK_ALIGNMENT, &alignment);
+      glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+      glBindTexture(GL_TEXTURE_2D, id);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_UNSIGNED_BYTE, data.data());
+      glBindTexture(GL_TEXTURE_2D, 0);
+
+      glPixelStorei(GL_PACK_ALIGNMENT, alignment);
+
+      return data;
+    }
+
+    void bind(GLint u) {
+      unit = u;
+      GLState::current().bindTexture(unit, GL_TEXTURE_2D, id);
+    }
+
+    void unbind() {
+      GLState::current().bindTexture(unit, GL_TEXTURE_2D, 0);
+      unit = -1;
+    }
+};
+
+/*
+ * Decodes a batch of images concurrently on a pool of worker threads.
+ * Only the decoding runs on the workers, GL uploads happen on the thread
+ * calling load(), which has to own the GL context. Uploads start as soon
+ * as the first image is ready, so they overlap with the remaining decodes.
+ * Images baked by asset_baker are only read from disk, not decoded.
+ *
+ * decode() stops short of the upload and returns the RGB pixels, for
+ * textures that are not a Texture each, like the layers of a TextureArray.
+ */
+class TextureLoader {
+  private:
+    struct Job {
+      std::string path;
+      std::string baked;
+      std::vector<uint8_t> dds;
+      uint8_t *pixels = nullptr;
+      int width  = 0;
+      int height = 0;
+      double decodeTime = 0.0;
+      std::string error;
+    };
+
+    std::vector<std::string> paths;
+    std::vector<double> times;
+    unsigned workers;
+
+  public:
+    struct Image {
+      std::vector<uint8_t> pixels;
+      int width;
+      int height;
+    };
+
+    TextureLoader(unsigned workers = std::thread::hardware_concurrency())
+      : workers { workers > 0 ? workers : 1 }
+    { }
+
+    void add(const std::string &path) {
+      paths.push_back(path);
+    }
+
+    /* Decode time of each file from the last load(), in milliseconds */
+    const std::vector<double> & decodeTimes() const {
+      return times;
+    }
+
+    /* Decodes every image to RGB on the workers, ignoring baked files */
+    std::vector<Image> decode() {
+      std::vector<Image> images(paths.size());
+      std::vector<std::string> errors(paths.size());
+      times.assign(paths.size(), 0.0);
+
+      std::mutex mutex;
+      size_t next = 0;
+
+      auto worker = [&]() {
+        while (true) {
+          size_t i;
+          {
+            std::lock_guard<std::mutex> lock { mutex };
+            if (next >= paths.size()) {
+              return;
+            }
+            i = next++;
+          }
+
+          Image &image = images[i];
+
+          auto start = std::chrono::steady_clock::now();
+          uint8_t *pixels = stbi_load(paths[i].c_str(), &image.width, &image.height, nullptr, STBI_rgb);
+          auto end = std::chrono::steady_clock::now();
+
+          times[i] = std::chrono::duration<double, std::milli>(end - start).count();
+
+          if (pixels == nullptr) {
+            const char *reason = stbi_failure_reason();
+            errors[i] = reason ? reason : "unknown error";
+            continue;
+          }
+
+          image.pixels.assign(pixels, pixels + image.width * image.height * 3);
+          stbi_image_free(pixels);
+        }
+      };
+
+      std::vector<std::thread> pool;
+      for (unsigned i = 0; i < workers && i < paths.size(); i++) {
+        pool.emplace_back(worker);
+      }
+
+      for (auto &t : pool) {
+        t.join();
+      }
+
+      for (size_t i = 0; i < paths.size(); i++) {
+        if (!errors[i].empty()) {
+          throw std::runtime_error { "Failed to load '" + paths[i] + "': " + errors[i] };
+        }
+
+        printf("Decoded '%s' (%dx%d) in %.1f ms\n", paths[i].c_str(), images[i].width, images[i].height, times[i]);
+      }
+
+      return images;
+    }
+
+    std::vector<std::unique_ptr<Texture>> load() {
+      std::vector<Job> jobs(paths.size());
+      for (size_t i = 0; i < jobs.size(); i++) {
+        jobs[i].path = paths[i];
+      }
+
+      std::mutex mutex;
+      std::condition_variable ready;
+      std::deque<size_t> decoded;
+      size_t next = 0;
+
+      auto worker = [&]() {
+        while (true) {
+          size_t i;
+          {
+            std::lock_guard<std::mutex> lock { mutex };
+            if (next >= jobs.size()) {
+              return;
+            }
+            i = next++;
+          }
+
+          Job &job = jobs[i];
+
+          auto start = std::chrono::steady_clock::now();
+          job.baked = Texture::bakedPath(job.path);
+          if (!job.baked.empty()) {
+            try {
+              job.dds = Texture::readFile(job.baked);
+            }
+            catch (const std::exception &e) {
+              job.error = e.what();
+            }
+          }
+          else {
+            job.pixels = stbi_load(job.path.c_str(), &job.width, &job.height, nullptr, STBI_rgb);
+          }
+          auto end = std::chrono::steady_clock::now();
+
+          job.decodeTime = std::chrono::duration<double, std::milli>(end - start).count();
+          if (job.baked.empty() && job.pixels == nullptr) {
+            const char *reason = stbi_failure_reason();
+            job.error = reason ? reason : "unknown error";
+          }
+
+          {
+            std::lock_guard<std::mutex> lock { mutex };
+            decoded.push_back(i);
+          }
+          ready.notify_one();
+        }
+      };
+
+      std::vector<std::thread> pool;
+      for (unsigned i = 0; i < workers && i < jobs.size(); i++) {
+        pool.emplace_back(worker);
+      }
+
+      /* Upload on this (the context) thread in order of completion */
+      std::vector<std::unique_ptr<Texture>> textures(jobs.size());
+      std::string error;
+
+      for (size_t uploaded = 0; uploaded < jobs.size(); uploaded++) {
+        size_t i;
+        {
+          std::unique_lock<std::mutex> lock { mutex };
+          ready.wait(lock, [&] { return !decoded.empty(); });
+          i = decoded.front();
+          decoded.pop_front();
+        }
+
+        Job &job = jobs[i];
+
+        if (!job.error.empty()) {
+          fprintf(stderr, "Decoding '%s' failed: %s\n", job.path.c_str(), job.error.c_str());
+          if (error.empty()) {
+            error = "Failed to load '" + job.path + "': " + job.error;
+          }
+          continue;
+        }
+
+        if (!job.baked.empty()) {
+          try {
+            textures[i].reset(new Texture(job.dds));
+          }
+          catch (const std::exception &e) {
+            fprintf(stderr, "Uploading '%s' failed: %s\n", job.baked.c_str(), e.what());
+            if (error.empty()) {
+              error = "Failed to load '" + job.baked + "': " + e.what();
+            }
+            continue;
+          }
+
+          printf("Read '%s' (%dx%d) in %.1f ms\n", job.baked.c_str(), textures[i]->width, textures[i]->height, job.decodeTime);
+          job.dds = { };
+          continue;
+        }
+
+        printf("Decoded '%s' (%dx%d) in %.1f ms\n", job.path.c_str(), job.width, job.height, job.decodeTime);
+
+        textures[i].reset(new Texture(job.pixels, job.width, job.height));
+        stbi_image_free(job.pixels);
+      }
+
+      for (auto &t : pool) {
+        t.join();
+      }
+
+      times.clear();
+      for (const Job &job : jobs) {
+        times.push_back(job.decodeTime);
+      }
+
+      if (!error.empty()) {
+        throw std::runtime_error { error };
+      }
+
+      return textures;
+    }
+};
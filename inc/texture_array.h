@@ -0,0 +1,298 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "gl_state.h"
+
+#include <SOIL.h>
+
+/* imgui_draw.cpp compiles its stb_rect_pack as static, so this copy is private too */
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include <stb_rect_pack.h>
+
+/*
+ * Same-sized RGB images as the layers of one GL_TEXTURE_2D_ARRAY, so a
+ * shader can reach all of them through a single sampler and bind. add()
+ * hands out the layer index the shader selects with.
+ */
+class TextureArray {
+  private:
+    GLuint id;
+    GLint unit;
+    int _w, _h;
+    int _layers;
+    int used;
+    bool mipmapsDirty;
+
+  public:
+    const int &width;
+    const int &height;
+
+    /* Decodes an image to RGB pixels, like Texture does */
+    static std::vector<uint8_t> loadRGB(const char *path, int &w, int &h) {
+      uint8_t *image = SOIL_load_image(path, &w, &h, nullptr, SOIL_LOAD_RGB);
+
+      if (image == nullptr) {
+        throw std::runtime_error {
+          std::string("Failed to load '") + path + "': " + SOIL_last_result()
+        };
+      }
+
+      std::vector<uint8_t> pixels { image, image + w * h * 3 };
+      SOIL_free_image_data(image);
+
+      return pixels;
+    }
+
+    TextureArray(int w, int h, int layers)
+      : width  { _w }
+      , height { _h }
+      , unit { -1 }
+      , _w { w }
+      , _h { h }
+      , _layers { layers }
+      , used { 0 }
+      , mipmapsDirty { false }
+    {
+      GLint maxLayers;
+      glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+
+      if (layers < 1 || layers > maxLayers) {
+        throw std::invalid_argument {
+          "Texture array needs between 1 and " + std::to_string(maxLayers) + " layers"
+        };
+      }
+
+      glGenTextures(1, &id);
+
+      glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB8, _w, _h, _layers, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    TextureArray(const TextureArray &) = delete;
+    TextureArray & operator=(const TextureArray &) = delete;
+
+    ~TextureArray() {
+      glDeleteTextures(1, &id);
+    }
+
+    /* Uploads RGB pixels into the next free layer and returns its index */
+    int add(const uint8_t *image, int w, int h) {
+      if (w != _w || h != _h) {
+        throw std::invalid_argument {
+          "Texture array layers are " + std::to_string(_w) + "x" + std::to_string(_h) +
+          ", got " + std::to_string(w) + "x" + std::to_string(h)
+        };
+      }
+
+      if (used == _layers) {
+        throw std::length_error { "Texture array is full" };
+      }
+
+      GLint alignment;
+      glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+      glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, used, _w, _h, 1, GL_RGB, GL_UNSIGNED_BYTE, image);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+      glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
+      /* Mipmaps are built once, on the next bind */
+      mipmapsDirty = true;
+
+      return used++;
+    }
+
+    int add(const char *path) {
+      int w, h;
+      std::vector<uint8_t> pixels = loadRGB(path, w, h);
+
+      return add(pixels.data(), w, h);
+    }
+
+    int size() const {
+      return used;
+    }
+
+    int capacity() const {
+      return _layers;
+    }
+
+    operator GLuint() const {
+      return id;
+    }
+
+    GLint boundUnit() const {
+      return unit;
+    }
+
+    void bind(GLint u) {
+      unit = u;
+      GLState &state = GLState::current();
+      state.bindTexture(unit, GL_TEXTURE_2D_ARRAY, id);
+
+      if (mipmapsDirty) {
+        state.setActiveUnit(unit);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+        mipmapsDirty = false;
+      }
+    }
+
+    void unbind() {
+      GLState::current().bindTexture(unit, GL_TEXTURE_2D_ARRAY, 0);
+      unit = -1;
+    }
+};
+
+/*
+ * Odd-sized RGB images packed into one GL_TEXTURE_2D with stb_rect_pack.
+ * add() hands out an index, region() the texture coordinates of that image.
+ * Every image gets a border of repeated edge pixels, so bilinear filtering
+ * at a region's edge does not pick up its neighbours. There are no mipmaps,
+ * they would blend the regions together.
+ */
+class TextureAtlas {
+  public:
+    struct Region {
+      float u0, v0;
+      float u1, v1;
+    };
+
+  private:
+    GLuint id;
+    GLint unit;
+    int _w, _h;
+    int padding;
+
+    stbrp_context context;
+    std::vector<stbrp_node> nodes;
+    std::vector<Region> regions;
+
+  public:
+    const int &width;
+    const int &height;
+
+    TextureAtlas(int w, int h, int padding = 2)
+      : width  { _w }
+      , height { _h }
+      , unit { -1 }
+      , _w { w }
+      , _h { h }
+      , padding { padding }
+      , nodes(w)
+    {
+      stbrp_init_target(&context, _w, _h, nodes.data(), (int) nodes.size());
+
+      glGenTextures(1, &id);
+
+      glBindTexture(GL_TEXTURE_2D, id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, _w, _h, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+      glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    TextureAtlas(const TextureAtlas &) = delete;
+    TextureAtlas & operator=(const TextureAtlas &) = delete;
+
+    ~TextureAtlas() {
+      glDeleteTextures(1, &id);
+    }
+
+    /* Packs RGB pixels into the atlas and returns their index */
+    int add(const uint8_t *image, int w, int h) {
+      stbrp_rect rect {};
+      rect.w = w + 2 * padding;
+      rect.h = h + 2 * padding;
+
+      stbrp_pack_rects(&context, &rect, 1);
+
+      if (!rect.was_packed) {
+        throw std::length_error {
+          "No room for a " + std::to_string(w) + "x" + std::to_string(h) + " image in the atlas"
+        };
+      }
+
+      /* Repeat the edge pixels into the border */
+      std::vector<uint8_t> padded(rect.w * rect.h * 3);
+      for (int y = 0; y < rect.h; y++) {
+        int sy = std::min(std::max(y - padding, 0), h - 1);
+
+        for (int x = 0; x < rect.w; x++) {
+          int sx = std::min(std::max(x - padding, 0), w - 1);
+
+          std::copy_n(image + (sy * w + sx) * 3, 3, &padded[(y * rect.w + x) * 3]);
+        }
+      }
+
+      GLint alignment;
+      glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+      glBindTexture(GL_TEXTURE_2D, id);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.w, rect.h, GL_RGB, GL_UNSIGNED_BYTE, padded.data());
+      glBindTexture(GL_TEXTURE_2D, 0);
+
+      glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
+      regions.push_back({
+        (rect.x + padding)     / (float) _w,
+        (rect.y + padding)     / (float) _h,
+        (rect.x + padding + w) / (float) _w,
+        (rect.y + padding + h) / (float) _h,
+      });
+
+      return (int) regions.size() - 1;
+    }
+
+    int add(const char *path) {
+      int w, h;
+      std::vector<uint8_t> pixels = TextureArray::loadRGB(path, w, h);
+
+      return add(pixels.data(), w, h);
+    }
+
+    const Region & region(int index) const {
+      return regions.at(index);
+    }
+
+    int size() const {
+      return (int) regions.size();
+    }
+
+    operator GLuint() const {
+      return id;
+    }
+
+    GLint boundUnit() const {
+      return unit;
+    }
+
+    void bind(GLint u) {
+      unit = u;
+      GLState::current().bindTexture(unit, GL_TEXTURE_2D, id);
+    }
+
+    void unbind() {
+      GLState::current().bindTexture(unit, GL_TEXTURE_2D, 0);
+      unit = -1;
+    }
+};
@@ -0,0 +1,14 @@
+#version 330 core
+
+uniform mat4 MVP;
+
+/* Bounds of the box in terrain space */
+uniform vec3 box_min;
+uniform vec3 box_max;
+
+/* Unit cube corner */
+layout (location = 0) in vec3 corner;
+
+void main() {
+  gl_Position = MVP * vec4(mix(box_min, box_max, corner), 1.0);
+}
@@ -0,0 +1,5 @@
+#version 330 core
+
+/* Depth pre-pass, outline.vert writes the only output that matters */
+void main() {
+}
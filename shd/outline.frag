@@ -1,7 +1,11 @@
 #version 330 core
 
 uniform sampler2D heightmap;
+uniform sampler2DArray materials;
+uniform usampler2D splat_index;
+uniform sampler2D splat_weight;
 uniform float map_size;
+uniform float material_scale;
 /* uniform float height; */
 
 in vec3 vpos;
@@ -11,5 +15,30 @@ out vec4 color;
 void main() {
   /* color = vec4(0.898, 0.867, 0.796, 1.0); */
   /* color = vec4(vpos.zzz / height, 1.0); */
-  color = texture(heightmap, vpos.xy / map_size);
+  /* color = texture(heightmap, vpos.xy / map_size); */
+
+  /* The 4 heaviest layers of this texel, sorted by weight */
+  vec2 uv = vpos.xy / map_size;
+  uvec4 layer  = texture(splat_index, uv);
+  vec4  weight = texture(splat_weight, uv);
+
+  /* Derivatives are taken outside the branches, which skip empty layers */
+  vec2 st = vpos.xy / material_scale;
+  vec2 dx = dFdx(st);
+  vec2 dy = dFdy(st);
+
+  vec3 c = weight.x * textureGrad(materials, vec3(st, layer.x), dx, dy).rgb;
+  if (weight.y > 0.0) {
+    c += weight.y * textureGrad(materials, vec3(st, layer.y), dx, dy).rgb;
+
+    if (weight.z > 0.0) {
+      c += weight.z * textureGrad(materials, vec3(st, layer.z), dx, dy).rgb;
+
+      if (weight.w > 0.0) {
+        c += weight.w * textureGrad(materials, vec3(st, layer.w), dx, dy).rgb;
+      }
+    }
+  }
+
+  color = vec4(c, 1.0);
 }
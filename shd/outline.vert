@@ -6,12 +6,40 @@ uniform sampler2D heightmap;
 uniform float map_size;
 uniform float height;
 
-layout (location = 0) in vec3 position;
+/* Camera position in terrain space, for the LOD morph */
+uniform vec3 camera;
+uniform float patch_quads;
+
+/* Patch grid vertex, in LOD 0 steps */
+layout (location = 0) in vec2 grid;
+
+/* Per patch: offset, size and LOD, and the distances it morphs over */
+layout (location = 1) in vec4 patch;
+layout (location = 2) in vec2 morph;
 
 out vec3 vpos;
 
+/* The depth pre-pass runs this shader too, its depths have to match exactly */
+invariant gl_Position;
+
+float heightAt(vec2 p) {
+  return texture(heightmap, p / map_size).z * height;
+}
+
+vec2 place(vec2 g) {
+  return patch.xy + g * (patch.z / patch_quads);
+}
+
 void main() {
-  float h = texture(heightmap, position.xy / map_size).z * height;
-  gl_Position = MVP * vec4(position.xy, h, 1.0);
-  vpos = position;
+  vec2 p = place(grid);
+  float k = clamp((distance(camera, vec3(p, heightAt(p))) - morph.x) / (morph.y - morph.x), 0.0, 1.0);
+
+  /* Slide the odd vertices of this LOD onto the next coarser grid */
+  float step = exp2(patch.w);
+  vec2 odd = fract(grid / (2.0 * step)) * 2.0 * step;
+  p = place(grid - odd * k);
+
+  float h = heightAt(p);
+  gl_Position = MVP * vec4(p, h, 1.0);
+  vpos = vec3(p, h);
 }
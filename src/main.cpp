@@ -3,6 +3,12 @@
 #include <vector>
 #include <iostream>
 #include <stdexcept>
+#include <atomic>
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <memory>
+#include <chrono>
 using namespace std;
 
 #define GLFW_INCLUDE_NONE
@@ -26,6 +32,17 @@ using namespace boost::filesystem;
 
 #include <SOIL.h>
 
+#include "frame_capture.h"
+#include "framebuffer.h"
+#include "gl_state.h"
+#include "render_queue.h"
+#include "sample_counter.h"
+#include "texture.h"
+#include "texture_array.h"
+#include "splat_map.h"
+#include "stream_buffer.h"
+#include "terrain.h"
+
 char *slurp_file(const char *path) {
   char *buffer = nullptr;
   uint32_t length;
@@ -59,6 +76,23 @@ void printf_vec3(const vec3 &v) {
   printf("[%f %f %f]\n", v.x, v.y, v.z);
 }
 
+/*
+ * Reverse-Z projection for a [0, 1] clip space depth range, see
+ * GLState::setClipDepth(). The near plane ends up at depth 1 and the far
+ * plane is at infinity, at depth 0, where float depth is the most precise.
+ */
+mat4 reverse_perspective(GLfloat fovy, GLfloat aspect, GLfloat near) {
+  GLfloat f = 1.0f / tan(fovy / 2.0f);
+
+  mat4 projection { 0.0f };
+  projection[0][0] = f / aspect;
+  projection[1][1] = f;
+  projection[2][3] = -1.0f;
+  projection[3][2] = near;
+
+  return projection;
+}
+
 class Camera {
   friend class CameraController;
 
@@ -224,6 +258,50 @@ class CameraController {
 
 CameraController controller;
 
+/* On-demand rendering: frames still to draw before the main loop may sleep */
+atomic<int> pendingFrames { 1 };
+
+/* Input can take ImGui a few frames to settle (hover, release, focus) */
+const int settleFrames = 3;
+
+/*
+ * Asks for at least `frames` more frames. Thread safe: background work
+ * finishing (e.g. streaming) calls it followed by glfwPostEmptyEvent().
+ */
+void request_frames(int frames) {
+  int pending = pendingFrames.load();
+  while (pending < frames && !pendingFrames.compare_exchange_weak(pending, frames)) { }
+}
+
+/* ImGui's callbacks, marking the frame dirty */
+void dirty_key_callback(GLFWwindow *window, int key, int scancode, int action, int mods) {
+  ImGui_ImplGlfwGL3_KeyCallback(window, key, scancode, action, mods);
+  request_frames(settleFrames);
+}
+
+void dirty_char_callback(GLFWwindow *window, unsigned int c) {
+  ImGui_ImplGlfwGL3_CharCallback(window, c);
+  request_frames(settleFrames);
+}
+
+void dirty_mouse_button_callback(GLFWwindow *window, int button, int action, int mods) {
+  ImGui_ImplGlfwGL3_MouseButtonCallback(window, button, action, mods);
+  request_frames(settleFrames);
+}
+
+void dirty_scroll_callback(GLFWwindow *window, double xoffset, double yoffset) {
+  ImGui_ImplGlfwGL3_ScrollCallback(window, xoffset, yoffset);
+  request_frames(settleFrames);
+}
+
+void dirty_cursor_callback(GLFWwindow *window, double xpos, double ypos) {
+  request_frames(settleFrames);
+}
+
+void dirty_refresh_callback(GLFWwindow *window) {
+  request_frames(1);
+}
+
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
   /* ImGui_ImplGlfwGL3_KeyCallback(window, key, scancode, action, mods); */
   controller.handleKey(key, action);
@@ -282,100 +360,369 @@ class Shader {
     }
 };
 
-class Uniform {
+/* An active uniform of a Program: its metadata and a CPU copy of its value */
+struct UniformSlot {
+  string name;
+  GLint location;
+  GLenum type;
+  GLint size;
+
+  /* Float types keep their value in floats, int, bool and sampler types in ints */
+  vector<GLfloat> floats;
+  vector<GLint> ints;
+
+  /* Copies a new value into the shadow, false if it equals the current one */
+  template <typename V>
+  static bool store(vector<V> &shadow, const V *value, size_t count) {
+    count = std::min(count, shadow.size());
+    if (std::equal(value, value + count, shadow.begin())) {
+      return false;
+    }
+
+    std::copy_n(value, count, shadow.begin());
+    return true;
+  }
+
+  template <typename V>
+  static void load(const vector<V> &shadow, V *value, size_t count) {
+    std::copy_n(shadow.begin(), std::min(count, shadow.size()), value);
+  }
+};
+
+/* GLSL name of a uniform type, for error messages */
+const char * glsl_type_name(GLenum type) {
+  switch (type) {
+    case GL_FLOAT:                      return "float";
+    case GL_FLOAT_VEC2:                 return "vec2";
+    case GL_FLOAT_VEC3:                 return "vec3";
+    case GL_FLOAT_VEC4:                 return "vec4";
+    case GL_FLOAT_MAT3:                 return "mat3";
+    case GL_FLOAT_MAT4:                 return "mat4";
+    case GL_INT:                        return "int";
+    case GL_BOOL:                       return "bool";
+    case GL_SAMPLER_2D:                 return "sampler2D";
+    case GL_SAMPLER_2D_ARRAY:           return "sampler2DArray";
+    case GL_INT_SAMPLER_2D:             return "isampler2D";
+    case GL_UNSIGNED_INT_SAMPLER_2D:    return "usampler2D";
+    case GL_INT_SAMPLER_2D_ARRAY:       return "isampler2DArray";
+    case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY: return "usampler2DArray";
+    default:                            return "unsupported type";
+  }
+}
+
+bool is_sampler_2d(GLenum type) {
+  return type == GL_SAMPLER_2D || type == GL_INT_SAMPLER_2D || type == GL_UNSIGNED_INT_SAMPLER_2D;
+}
+
+bool is_sampler_2d_array(GLenum type) {
+  return type == GL_SAMPLER_2D_ARRAY || type == GL_INT_SAMPLER_2D_ARRAY || type == GL_UNSIGNED_INT_SAMPLER_2D_ARRAY;
+}
+
+/*
+ * How a C++ type reaches a uniform: the GL types it may be bound to, how it
+ * packs into the CPU shadow and the glUniform* call that uploads it. Types
+ * without a specialization do not compile as uniform values.
+ */
+template <typename T>
+struct UniformTraits {
+  static_assert(sizeof(T) == 0, "No uniform binding for this type, add a UniformTraits specialization");
+};
+
+struct UniformFloats {
+  using Value = GLfloat;
+  static vector<GLfloat> & shadow(UniformSlot &u) { return u.floats; }
+};
+
+struct UniformInts {
+  using Value = GLint;
+  static vector<GLint> & shadow(UniformSlot &u) { return u.ints; }
+};
+
+template <>
+struct UniformTraits<float> : UniformFloats {
+  static const size_t count = 1;
+  static const char * glsl() { return "float"; }
+  static bool accepts(GLenum type) { return type == GL_FLOAT; }
+  static void pack(const float &f, GLfloat *v) { v[0] = f; }
+  static float unpack(const GLfloat *v) { return v[0]; }
+  static void upload(GLint location, const GLfloat *v) { glUniform1fv(location, 1, v); }
+};
+
+template <>
+struct UniformTraits<vec2> : UniformFloats {
+  static const size_t count = 2;
+  static const char * glsl() { return "vec2"; }
+  static bool accepts(GLenum type) { return type == GL_FLOAT_VEC2; }
+  static void pack(const vec2 &x, GLfloat *v) { std::copy_n(value_ptr(x), count, v); }
+  static vec2 unpack(const GLfloat *v) { return make_vec2(v); }
+  static void upload(GLint location, const GLfloat *v) { glUniform2fv(location, 1, v); }
+};
+
+template <>
+struct UniformTraits<vec3> : UniformFloats {
+  static const size_t count = 3;
+  static const char * glsl() { return "vec3"; }
+  static bool accepts(GLenum type) { return type == GL_FLOAT_VEC3; }
+  static void pack(const vec3 &x, GLfloat *v) { std::copy_n(value_ptr(x), count, v); }
+  static vec3 unpack(const GLfloat *v) { return make_vec3(v); }
+  static void upload(GLint location, const GLfloat *v) { glUniform3fv(location, 1, v); }
+};
+
+template <>
+struct UniformTraits<vec4> : UniformFloats {
+  static const size_t count = 4;
+  static const char * glsl() { return "vec4"; }
+  static bool accepts(GLenum type) { return type == GL_FLOAT_VEC4; }
+  static void pack(const vec4 &x, GLfloat *v) { std::copy_n(value_ptr(x), count, v); }
+  static vec4 unpack(const GLfloat *v) { return make_vec4(v); }
+  static void upload(GLint location, const GLfloat *v) { glUniform4fv(location, 1, v); }
+};
+
+template <>
+struct UniformTraits<mat3> : UniformFloats {
+  static const size_t count = 9;
+  static const char * glsl() { return "mat3"; }
+  static bool accepts(GLenum type) { return type == GL_FLOAT_MAT3; }
+  static void pack(const mat3 &m, GLfloat *v) { std::copy_n(value_ptr(m), count, v); }
+  static mat3 unpack(const GLfloat *v) { return make_mat3(v); }
+  static void upload(GLint location, const GLfloat *v) { glUniformMatrix3fv(location, 1, GL_FALSE, v); }
+};
+
+template <>
+struct UniformTraits<mat4> : UniformFloats {
+  static const size_t count = 16;
+  static const char * glsl() { return "mat4"; }
+  static bool accepts(GLenum type) { return type == GL_FLOAT_MAT4; }
+  static void pack(const mat4 &m, GLfloat *v) { std::copy_n(value_ptr(m), count, v); }
+  static mat4 unpack(const GLfloat *v) { return make_mat4(v); }
+  static void upload(GLint location, const GLfloat *v) { glUniformMatrix4fv(location, 1, GL_FALSE, v); }
+};
+
+/* Plain ints also set samplers to a texture unit, like SplatMap's */
+template <>
+struct UniformTraits<GLint> : UniformInts {
+  static const size_t count = 1;
+  static const char * glsl() { return "int"; }
+  static bool accepts(GLenum type) {
+    return type == GL_INT || type == GL_BOOL || is_sampler_2d(type) || is_sampler_2d_array(type);
+  }
+  static void pack(const GLint &i, GLint *v) { v[0] = i; }
+  static GLint unpack(const GLint *v) { return v[0]; }
+  static void upload(GLint location, const GLint *v) { glUniform1iv(location, 1, v); }
+};
+
+/* Samplers take the unit the texture is bound to, bind() it first */
+template <typename T>
+struct UniformSampler : UniformInts {
+  static const size_t count = 1;
+  static void pack(const T &t, GLint *v) { v[0] = t.boundUnit(); }
+  static void upload(GLint location, const GLint *v) { glUniform1iv(location, 1, v); }
+};
+
+template <>
+struct UniformTraits<Texture> : UniformSampler<Texture> {
+  static const char * glsl() { return "sampler2D"; }
+  static bool accepts(GLenum type) { return is_sampler_2d(type); }
+};
+
+template <>
+struct UniformTraits<TextureAtlas> : UniformSampler<TextureAtlas> {
+  static const char * glsl() { return "sampler2D"; }
+  static bool accepts(GLenum type) { return is_sampler_2d(type); }
+};
+
+template <>
+struct UniformTraits<TextureArray> : UniformSampler<TextureArray> {
+  static const char * glsl() { return "sampler2DArray"; }
+  static bool accepts(GLenum type) { return is_sampler_2d_array(type); }
+};
+
+/* An atlas region as vec4(u0, v0, u1, v1) */
+template <>
+struct UniformTraits<TextureAtlas::Region> : UniformFloats {
+  static const size_t count = 4;
+  static const char * glsl() { return "vec4"; }
+  static bool accepts(GLenum type) { return type == GL_FLOAT_VEC4; }
+  static void pack(const TextureAtlas::Region &r, GLfloat *v) {
+    v[0] = r.u0; v[1] = r.v0; v[2] = r.u1; v[3] = r.v1;
+  }
+  static TextureAtlas::Region unpack(const GLfloat *v) { return { v[0], v[1], v[2], v[3] }; }
+  static void upload(GLint location, const GLfloat *v) { glUniform4fv(location, 1, v); }
+};
+
+/*
+ * A uniform bound to a C++ type, see Program::bind(). Its GL type has been
+ * checked when the binding was made, so setting it only compares against
+ * the shadow and, when the value changed, uploads it.
+ */
+template <typename T>
+class UniformBinding {
   friend class Program;
+  friend class Uniform;
 
   private:
+    using Traits = UniformTraits<T>;
+    using Value  = typename Traits::Value;
+
     GLuint program;
-    const char *name;
+    UniformSlot *slot;
 
-    Uniform(GLuint id, const char *name)
+    /* `slot` is null for names that are not an active uniform */
+    UniformBinding(GLuint id, UniformSlot *slot)
       : program { id }
-      , name { name }
-      , location { glGetUniformLocation(program, name) }
+      , slot { slot }
     { }
 
-    template <typename T>
-    void set(const T &value) {
-      throw domain_error {
-        "Uniform assignment not implemented for " + string(typeid(T).name())
-      };
+    /* The link-time check, a mismatch is an error in the program's setup */
+    static UniformBinding checked(GLuint id, const char *programName, UniformSlot *slot) {
+      if (slot && !Traits::accepts(slot->type)) {
+        throw domain_error {
+          "Uniform '" + slot->name + "' of program '" + programName + "' is a " +
+          glsl_type_name(slot->type) + ", it cannot be bound as a " + Traits::glsl()
+        };
+      }
+
+      return { id, slot };
     }
 
-    template <typename T>
-    T get() {
-      throw domain_error {
-        "Uniform retrieval not implemented for " + string(typeid(T).name())
-      };
+    /* Runs a glUniform* call with the program in use, it stays in use */
+    template <typename F>
+    void push(F call) {
+      GLState::current().useProgram(program);
+      call();
     }
 
+  public:
+    UniformBinding()
+      : program { 0 }
+      , slot { nullptr }
+    { }
+
+    GLint location() const {
+      return slot ? slot->location : -1;
+    }
+
+    /* Values only reach GL when they change */
+    UniformBinding & operator=(const T &value) {
+      if (slot == nullptr) {
+        return *this;
+      }
+
+      Value v[Traits::count];
+      Traits::pack(value, v);
+
+      if (UniformSlot::store(Traits::shadow(*slot), v, Traits::count)) {
+        push([&]() { Traits::upload(slot->location, v); });
+      }
+
+      return *this;
+    }
+
+    operator T() const {
+      Value v[Traits::count] { };
+      if (slot) {
+        UniformSlot::load(Traits::shadow(*slot), v, Traits::count);
+      }
+      return Traits::unpack(v);
+    }
+};
+
+/*
+ * Untyped handle returned by Program::operator[], for one-off assignments.
+ * Every use binds the value's type like Program::bind() would, per-frame
+ * uniforms should keep a UniformBinding instead.
+ */
+class Uniform {
+  friend class Program;
+
+  private:
+    GLuint program;
+    const char *programName;
+    UniformSlot *slot;
+
+    Uniform(GLuint id, const char *programName, UniformSlot *slot)
+      : program { id }
+      , programName { programName }
+      , slot { slot }
+      , location { slot ? slot->location : -1 }
+    { }
+
   public:
     const GLint location;
 
     template <typename T>
     void operator=(const T &value) {
-      set<T>(value);
+      UniformBinding<T>::checked(program, programName, slot) = value;
     }
 
     template <typename T>
-    operator T() {
-      return get<T>();
+    operator T() const {
+      return UniformBinding<T>::checked(program, programName, slot);
     }
 };
 
-/* Uniform implementations */
-template <>
-void Uniform::set(const vec3 &v) {
-  GLint old_id;
-  glGetIntegerv(GL_CURRENT_PROGRAM, &old_id);
+class Program {
+  private:
+    /* Active uniforms, looked up once after linking */
+    vector<UniformSlot> uniforms;
 
-  glUseProgram(program);
-  glUniform3f(location, v.x, v.y, v.z);
-  glUseProgram(old_id);
-}
+    void introspect() {
+      GLint count, maxLength;
+      glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+      glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
 
-template <>
-vec3 Uniform::get() {
-  vec3 v;
-  glGetUniformfv(program, location, value_ptr(v));
-  return v;
-}
+      vector<GLchar> buffer(maxLength + 1);
 
-template <>
-void Uniform::set(const mat4 &m) {
-  GLint old_id;
-  glGetIntegerv(GL_CURRENT_PROGRAM, &old_id);
+      for (GLint i = 0; i < count; i++) {
+        UniformSlot u;
+        GLsizei length;
 
-  glUseProgram(program);
-  glUniformMatrix4fv(location, 1, GL_FALSE, value_ptr(m));
-  glUseProgram(old_id);
-}
+        glGetActiveUniform(id, i, (GLsizei) buffer.size(), &length, &u.size, &u.type, buffer.data());
+        u.name.assign(buffer.data(), length);
 
-template <>
-mat4 Uniform::get() {
-  mat4 m;
-  glGetUniformfv(program, location, value_ptr(m));
-  return m;
-}
+        /* Arrays are reported as "name[0]" */
+        if (u.name.size() > 3 && u.name.compare(u.name.size() - 3, 3, "[0]") == 0) {
+          u.name.resize(u.name.size() - 3);
+        }
 
-template <>
-void Uniform::set(const float &f) {
-  GLint old_id;
-  glGetIntegerv(GL_CURRENT_PROGRAM, &old_id);
+        /* Uniforms of named blocks have no location */
+        u.location = glGetUniformLocation(id, u.name.c_str());
+        if (u.location < 0) {
+          continue;
+        }
 
-  glUseProgram(program);
-  glUniform1f(location, f);
-  glUseProgram(old_id);
-}
+        switch (u.type) {
+          case GL_FLOAT:      u.floats.resize(1);  break;
+          case GL_FLOAT_VEC2: u.floats.resize(2);  break;
+          case GL_FLOAT_VEC3: u.floats.resize(3);  break;
+          case GL_FLOAT_VEC4: u.floats.resize(4);  break;
+          case GL_FLOAT_MAT3: u.floats.resize(9);  break;
+          case GL_FLOAT_MAT4: u.floats.resize(16); break;
+          default:            u.ints.resize(1);    break;
+        }
 
-template <>
-float Uniform::get() {
-  float f;
-  glGetUniformfv(program, location, &f);
-  return f;
-}
+        /* The only readback, the shadow tracks every later change */
+        if (!u.floats.empty()) {
+          glGetUniformfv(id, u.location, u.floats.data());
+        }
+        else {
+          glGetUniformiv(id, u.location, u.ints.data());
+        }
+
+        uniforms.push_back(u);
+      }
+    }
+
+    UniformSlot * find(const char *uniform) {
+      for (UniformSlot &u : uniforms) {
+        if (u.name == uniform) {
+          return &u;
+        }
+      }
+
+      return nullptr;
+    }
 
-class Program {
   public:
     GLuint id;
     const char *name;
@@ -402,14 +749,24 @@ class Program {
 
       glDetachShader(id, vsh.id);
       glDetachShader(id, fsh.id);
+
+      if (success) {
+        introspect();
+      }
     }
 
     ~Program() {
       glDeleteProgram(id);
     }
 
-    Uniform getUniform(const char *name) {
-      return Uniform(id, name);
+    Uniform getUniform(const char *uniform) {
+      return Uniform(id, name, find(uniform));
+    }
+
+    /* Binds a uniform to a C++ type, throws if its GL type does not fit */
+    template <typename T>
+    UniformBinding<T> bind(const char *uniform) {
+      return UniformBinding<T>::checked(id, name, find(uniform));
     }
 
     Uniform operator[](const char *name) {
@@ -418,36 +775,26 @@ class Program {
 
     operator GLuint() const { return id; }
 
+    /* Edits the shadow values, only what the user changes is pushed to GL */
     void editor() {
       ImGui::Begin(name);
 
-      GLint count;
-      glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
-
-      for (GLuint i = 0; i < count; i++) {
-        GLint size;
-        GLenum type;
-
-        const GLsizei bufSize = 16;
-        GLchar name[bufSize];
-        GLsizei length;
-
-        glGetActiveUniform(id, i, bufSize, &length, &size, &type, name);
-        
-        switch (type) {
+      for (UniformSlot &u : uniforms) {
+        switch (u.type) {
           case GL_FLOAT_VEC3: {
-            vec3 v = getUniform(name);
-
-            glGetUniformfv(id, getUniform(name).location, value_ptr(v));
-            ImGui::ColorEdit3(name, value_ptr(v));
-
-            getUniform(name) = v;
+            UniformBinding<vec3> uniform { id, &u };
+            vec3 v = uniform;
+            if (ImGui::ColorEdit3(u.name.c_str(), value_ptr(v))) {
+              uniform = v;
+            }
           } break;
 
           case GL_FLOAT: {
-            float f = getUniform(name);
-            ImGui::SliderFloat(name, &f, 0.0f, 4096.0f, "%.0f");
-            getUniform(name) = f;
+            UniformBinding<float> uniform { id, &u };
+            float f = uniform;
+            if (ImGui::SliderFloat(u.name.c_str(), &f, 0.0f, 4096.0f, "%.0f")) {
+              uniform = f;
+            }
           } break;
 
           default:
@@ -459,81 +806,115 @@ class Program {
     }
 };
 
-class Texture {
-  private:
-    GLuint id;
-    GLint unit;
-    int _w, _h;
+void usage(const char *program) {
+  fprintf(stderr,
+    "usage: %s [-capture directory [-frames n] | -batch heightmap cameras directory] [-size WxH] [-format tga|bmp|raw]\n",
+    program);
+}
 
-  public:
-    const int &width;
-    const int &height;
+/* A camera of a batch render */
+struct View {
+  vec3 position;
+  vec3 target;
+};
 
-    Texture(const char *path)
-      : width  { _w }
-      , height { _h }
-      , unit { -1 }
-    {
-      uint8_t *image = SOIL_load_image(path, &_w, &_h, nullptr, SOIL_LOAD_RGB);
+/* One view per line, "px py pz tx ty tz", empty lines and lines starting with # are skipped */
+vector<View> read_camera_path(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (f == nullptr) {
+    throw runtime_error { "Could not open '" + string(path) + "'" };
+  }
 
-      if (image == nullptr) {
-        throw runtime_error {
-          SOIL_last_result()
-        };
-      }
+  vector<View> views;
+  char line[256];
 
-      glGenTextures(1, &id);  
+  for (int number = 1; fgets(line, sizeof(line), f) != nullptr; number++) {
+    char first = 0;
+    if (sscanf(line, " %c", &first) != 1 || first == '#') {
+      continue;
+    }
 
-      glBindTexture(GL_TEXTURE_2D, id);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    View v;
+    if (sscanf(line, "%f %f %f %f %f %f",
+               &v.position.x, &v.position.y, &v.position.z,
+               &v.target.x,   &v.target.y,   &v.target.z) != 6) {
+      fclose(f);
+      throw runtime_error { string(path) + ":" + to_string(number) + ": expected 'px py pz tx ty tz'" };
+    }
 
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, _w, _h, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-        glGenerateMipmap(GL_TEXTURE_2D);
-      glBindTexture(GL_TEXTURE_2D, 0);
+    views.push_back(v);
+  }
 
-      SOIL_free_image_data(image);
-    }
+  fclose(f);
 
-    ~Texture() {
-      glDeleteTextures(1, &id);
-    }
+  if (views.empty()) {
+    throw runtime_error { "No views in '" + string(path) + "'" };
+  }
 
-    operator GLuint() {
-      return id;
-    }
+  return views;
+}
 
-    operator GLuint() const {
-      return id;
+int main(int argc, char *argv[]) {
+  /*
+   * Capture renders offscreen at its own size and writes every frame. A
+   * batch captures one frame per view of a camera path, over any heightmap.
+   */
+  const char *captureDirectory = nullptr;
+  const char *captureFormat = "tga";
+  int captureFrames = 1;
+  int captureWidth = 0, captureHeight = 0;
+  const char *batchHeightmap = nullptr, *batchCameras = nullptr;
+
+  for (int arg = 1; arg < argc; arg++) {
+    string option = argv[arg];
+    bool valid = arg + 1 < argc;
+
+    if (valid && option == "-capture") {
+      captureDirectory = argv[++arg];
     }
-
-    void bind(GLint u) {
-      unit = u;
-      glActiveTexture(GL_TEXTURE0 + unit);
-      glBindTexture(GL_TEXTURE_2D, id);
+    else if (option == "-batch" && arg + 3 < argc) {
+      batchHeightmap   = argv[++arg];
+      batchCameras     = argv[++arg];
+      captureDirectory = argv[++arg];
+    }
+    else if (valid && option == "-frames") {
+      captureFrames = atoi(argv[++arg]);
+      valid = captureFrames > 0;
+    }
+    else if (valid && option == "-size") {
+      valid = sscanf(argv[++arg], "%dx%d", &captureWidth, &captureHeight) == 2 && captureWidth > 0 && captureHeight > 0;
+    }
+    else if (valid && option == "-format") {
+      captureFormat = argv[++arg];
+      valid = strcmp(captureFormat, "tga") == 0 || strcmp(captureFormat, "bmp") == 0 || strcmp(captureFormat, "raw") == 0;
+    }
+    else {
+      valid = false;
     }
 
-    void unbind() {
-      glActiveTexture(GL_TEXTURE0 + unit);
-      glBindTexture(GL_TEXTURE_2D, 0);
-      unit = -1;
+    if (!valid) {
+      usage(argv[0]);
+      return EXIT_FAILURE;
     }
-};
+  }
 
-template <>
-void Uniform::set(const Texture &t) {
-  GLint old_id;
-  glGetIntegerv(GL_CURRENT_PROGRAM, &old_id);
+  const bool capturing = captureDirectory != nullptr;
+  const bool batch = batchHeightmap != nullptr;
 
-  glUseProgram(program);
-  glUniform1ui(location, t);
-  glUseProgram(old_id);
-}
+  vector<View> views;
+  if (batch) {
+    try {
+      views = read_camera_path(batchCameras);
+    }
+    catch (const exception &e) {
+      fprintf(stderr, "%s\n", e.what());
+      return EXIT_FAILURE;
+    }
+
+    captureFrames = (int) views.size();
+  }
 
-int main() {
-  /* Create a window */
+  /* Create a window, hidden while capturing */
   glfwSetErrorCallback(error_callback);
 
   glfwInit();
@@ -544,18 +925,27 @@ int main() {
   glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT,  GL_TRUE);
   glfwWindowHint(GLFW_RESIZABLE,              GL_FALSE);
   glfwWindowHint(GLFW_FOCUSED,                GL_TRUE);
+  glfwWindowHint(GLFW_VISIBLE,                capturing ? GL_FALSE : GL_TRUE);
   /* glfwWindowHint(GLFW_SAMPLES,                4); */
 
   GLFWwindow *window = glfwCreateWindow(800, 600, "", nullptr, nullptr);
 
   /* glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED); */
 
-  /* Initialize ImGui */
-  ImGui_ImplGlfwGL3_Init(window, true);
-
-  /* Set up callbacks */
-  /* glfwSetKeyCallback(window, key_callback); */
-  /* glfwSetCursorPosCallback(window, mouse_callback); */
+  /* Initialize ImGui, batch renders go without it */
+  if (!batch) {
+    ImGui_ImplGlfwGL3_Init(window, true);
+
+    /* Set up callbacks */
+    /* glfwSetKeyCallback(window, key_callback); */
+    /* glfwSetCursorPosCallback(window, mouse_callback); */
+    glfwSetKeyCallback(window, dirty_key_callback);
+    glfwSetCharCallback(window, dirty_char_callback);
+    glfwSetMouseButtonCallback(window, dirty_mouse_button_callback);
+    glfwSetScrollCallback(window, dirty_scroll_callback);
+    glfwSetCursorPosCallback(window, dirty_cursor_callback);
+    glfwSetWindowRefreshCallback(window, dirty_refresh_callback);
+  }
 
   /* Initialize OpenGL */
   glfwMakeContextCurrent(window);
@@ -567,11 +957,17 @@ int main() {
     exit(EXIT_FAILURE);
   }
 
-  glEnable(GL_DEPTH_TEST);
+  /* Per-frame data is streamed through one ring buffer */
+  StreamBuffer stream;
+  if (!batch) {
+    ImGui_ImplGlfwGL3_SetStreamBuffer(&stream);
+  }
+
+  /* Depth testing is set every frame, the UI turns it off */
   /* glEnable(GL_CULL_FACE); */
 
-  /* VSync on */
-  glfwSwapInterval(1);
+  /* VSync on, captures run as fast as they can */
+  glfwSwapInterval(capturing ? 0 : 1);
 
   /* Create data */
   //                            /*                       */
@@ -601,51 +997,6 @@ int main() {
   /* Create map */
   const GLuint map_size = 2048;
 
-  vector<GLfloat> vertices;
-  vector<GLuint> indices;
-
-  for (GLuint y = 0; y < map_size; y++) {
-    for (GLuint x = 0; x < map_size; x++) {
-      vertices.insert(vertices.end(), {
-          x * 1.0f,
-          y * 1.0f,
-          0.0f,
-      });
-    }
-  }
-
-  for (GLuint y = 0; y < map_size - 1; y++) {
-    for (GLuint x = 0; x < map_size - 1; x++) {
-      indices.insert(indices.end(), {
-        (y + 0) * map_size + (x + 0),
-        (y + 0) * map_size + (x + 1),
-        (y + 1) * map_size + (x + 1),
-        (y + 0) * map_size + (x + 0),
-        (y + 1) * map_size + (x + 1),
-        (y + 1) * map_size + (x + 0),
-      });
-    }
-  }
-
-  /* Create buffers */
-  GLuint vao;
-  glGenVertexArrays(1, &vao);
-
-  GLuint vbo, ebo;
-  glGenBuffers(1, &vbo);
-  glGenBuffers(1, &ebo);
-
-  glBindVertexArray(vao);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLfloat), indices.data(), GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), nullptr);
-    glEnableVertexAttribArray(0);
-  glBindVertexArray(0);
-
   mat4 model;
   /* model *= rotate(radians(90.0f), vec3(1.0f, 0.0f, 0.0f)); */
   /* model *= rotate(radians(-90.0f), vec3(0.0f, 1.0f, 0.0f)); */
@@ -654,7 +1005,42 @@ int main() {
   /* model *= translate(vec3(map_size * -0.5f, map_size * -0.5f, 0.0f)); */
 
   /* Load textures */
-  Texture heightmap { "res/spindl.jpg" };
+  TextureLoader loader;
+  loader.add(batch ? batchHeightmap : "res/spindl.jpg");
+
+  auto textures = loader.load();
+  Texture &heightmap = *textures[0];
+
+  /* Materials, splatted by height and slope */
+  TextureLoader layers;
+  layers.add("res/forest.jpg");
+  layers.add("res/island.png");
+  layers.add("res/mountains.jpg");
+
+  auto images = layers.decode();
+
+  TextureArray materials { 1024, 1024, 3 };
+  const int grass = materials.add(images[0].pixels.data(), images[0].width, images[0].height);
+  const int sand  = materials.add(images[1].pixels.data(), images[1].width, images[1].height);
+  const int rock  = materials.add(images[2].pixels.data(), images[2].width, images[2].height);
+
+  const GLfloat height = map_size / 4.0f;
+  const vector<uint8_t> heights = heightmap.pixels();
+
+  /* Terrain patches, drawn instanced */
+  Terrain terrain { stream, heights, heightmap.width, heightmap.height, map_size, height };
+
+  SplatMap splat {
+    heights, heightmap.width, heightmap.height,
+    /* Terrain height in heightmap texels */
+    height / ((GLfloat) map_size / heightmap.width),
+    {
+      /* layer  height        slope        fade */
+      { grass,  0.00f, 0.45f, 0.00f, 0.25f, 0.05f },
+      { sand,   0.40f, 1.00f, 0.00f, 0.25f, 0.05f },
+      { rock,   0.00f, 1.00f, 0.20f, 1.00f, 0.05f },
+    }
+  };
 
   /* Cameras */
   mat4 projection = perspective(radians(60.0f), 4.0f / 3.0f, 0.01f, 100.0f);
@@ -668,8 +1054,52 @@ int main() {
   Program outline { "Outline", "shd/outline.vert", "shd/outline.frag" };
 
   outline["MVP"]      = projection * view * model;
-  outline["map_size"] = (GLfloat) map_size - 1;
-  outline["height"]   = map_size / 4.0f;
+  outline["map_size"] = (GLfloat) map_size;
+  outline["height"]   = height;
+  outline["material_scale"] = 64.0f;
+  outline["patch_quads"] = (GLfloat) terrain.patchQuads();
+
+  /* Per-frame uniforms, their types are checked once here */
+  auto outlineMVP         = outline.bind<mat4>("MVP");
+  auto outlineCamera      = outline.bind<vec3>("camera");
+  auto outlineHeightmap   = outline.bind<Texture>("heightmap");
+  auto outlineMaterials   = outline.bind<TextureArray>("materials");
+  auto outlineSplatIndex  = outline.bind<GLint>("splat_index");
+  auto outlineSplatWeight = outline.bind<GLint>("splat_weight");
+
+  /* Depth pre-pass, same vertices with an empty fragment shader */
+  Program depth { "Depth", "shd/outline.vert", "shd/depth.frag" };
+
+  depth["map_size"]    = (GLfloat) map_size;
+  depth["height"]      = height;
+  depth["patch_quads"] = (GLfloat) terrain.patchQuads();
+
+  auto depthMVP       = depth.bind<mat4>("MVP");
+  auto depthCamera    = depth.bind<vec3>("camera");
+  auto depthHeightmap = depth.bind<Texture>("heightmap");
+
+  /* Patch bounding boxes for the occlusion queries */
+  Program box { "Box", "shd/box.vert", "shd/depth.frag" };
+
+  auto boxMVP = box.bind<mat4>("MVP");
+  auto boxMin = box.bind<vec3>("box_min");
+  auto boxMax = box.bind<vec3>("box_max");
+
+  /* Setup bound textures and vertex arrays behind the state tracker's back */
+  GLState &state = GLState::current();
+  state.invalidate();
+
+  /* Calls of the last frame, for the profiler */
+  GLState::Stats glCalls = state.stats;
+
+  /* Draws are queued during the frame and run sorted by state */
+  RenderQueue queue;
+
+  const int terrainTextures = queue.addTextureSet([&]() {
+    heightmap.bind(0);
+    materials.bind(1);
+    splat.bind(2, 3);
+  });
 
   /* Timing */
   GLfloat delta = 0.0f;
@@ -681,30 +1111,141 @@ int main() {
 
   float rot[3] { -90.0f, 0.0f, 0.0f };
 
+  bool cacheUi = false;
+
+  /* Sleep while nothing changes, waking up every idleTimeout seconds */
+  bool onDemand = false;
+
+  /* Fragments passing the depth test in the terrain passes, for the overdraw */
+  bool depthPrepass = false;
+  SampleCounter prepassSamples, shadedSamples;
+
+  int framebufferWidth, framebufferHeight;
+  glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+  const double idleTimeout = 0.5;
+
+  /* Reverse-Z and captures render offscreen, then blit to the window */
+  const bool reverseZSupported = GLEW_VERSION_4_5 || GLEW_ARB_clip_control;
+  bool reverseZ = false;
+  Framebuffer scene {
+    captureWidth  > 0 ? captureWidth  : framebufferWidth,
+    captureHeight > 0 ? captureHeight : framebufferHeight
+  };
+
+  const double pixels = (double) scene.width * scene.height;
+  const GLfloat aspect = (GLfloat) scene.width / scene.height;
+
+  /* Frames are read back a frame late and encoded on worker threads */
+  unique_ptr<FrameWriter> writer;
+  unique_ptr<FrameCapture> capture;
+  if (capturing) {
+    create_directories(captureDirectory);
+
+    writer.reset(new FrameWriter(captureDirectory, captureFormat, scene.width, scene.height));
+    capture.reset(new FrameCapture(scene.width, scene.height, [&](int frame, vector<uint8_t> &&image) {
+      writer->write(frame, move(image));
+    }));
+  }
+
+  auto captureStart = chrono::steady_clock::now();
+
+  /* A frame that could not be read back or written ends the capture */
+  bool captureFailed = false;
+
   /* Main loop */
   while (!glfwWindowShouldClose(window)) {
+    /* Input, on demand the loop sleeps until something marks the frame dirty */
+    if (onDemand && !capturing && pendingFrames == 0) {
+      glfwWaitEventsTimeout(idleTimeout);
+
+      if (pendingFrames == 0) {
+        continue;
+      }
+    }
+    else {
+      glfwPollEvents();
+    }
+
+    if (pendingFrames > 0) {
+      pendingFrames--;
+    }
+
     /* Timing */
-    GLfloat currentFrame = glfwGetTime();
+    /* Captures advance a fixed 60 Hz step per frame, the same every run */
+    GLfloat currentFrame = capturing ? capture->frames() / 60.0f : glfwGetTime();
     delta = currentFrame - lastFrame;
     lastFrame = currentFrame;
 
-    /* Input */
-    glfwPollEvents();
-    ImGui_ImplGlfwGL3_NewFrame();
+    glCalls = state.stats;
+    state.resetStats();
 
     /* controller.update(delta); */
 
-    /* Shader editors */
-    ImGui::Begin("Camera & model");
-      ImGui::SliderFloat3("Camera position", value_ptr(position), -30.0f, 30.0f);
-      ImGui::SliderFloat3("Camera target",   value_ptr(target),   -30.0f, 30.0f);
+    /* Batch renders have no UI */
+    if (!batch) {
+      ImGui_ImplGlfwGL3_NewFrame();
 
-      ImGui::SliderFloat3("Rotation", rot, 0.0f, 360.0f);
+      /* Shader editors */
+      ImGui::Begin("Camera & model");
+        ImGui::SliderFloat3("Camera position", value_ptr(position), -30.0f, 30.0f);
+        ImGui::SliderFloat3("Camera target",   value_ptr(target),   -30.0f, 30.0f);
 
-      ImGui::Image((GLvoid*)(GLuint)heightmap, ImVec2(100, 100), ImVec2(0,0), ImVec2(1,1), ImColor(255,255,255,255), ImColor(255,255,255,128));
-    ImGui::End();
+        ImGui::SliderFloat3("Rotation", rot, 0.0f, 360.0f);
 
-    mat4 projection = perspective(radians(60.0f), 4.0f / 3.0f, 0.01f, 100.0f);
+        ImGui::SliderFloat("LOD distance", &terrain.lodDistance, terrain.minLodDistance(), std::max(1024.0f, 2.0f * terrain.minLodDistance()), "%.0f");
+        if (terrain.multiDrawIndirectSupported()) {
+          ImGui::Checkbox("Multi-draw indirect", &terrain.multiDraw);
+        }
+        ImGui::Text("%d patches in %d draw calls", terrain.stats.visible, terrain.stats.drawCalls);
+        if (reverseZSupported) {
+          ImGui::Checkbox("Reverse-Z (infinite far plane)", &reverseZ);
+        }
+
+        /* Skips the UI upload while its draw data does not change */
+        /* On demand needs the draw data hashes to see UI changes */
+        bool toggled = ImGui::Checkbox("Cache UI", &cacheUi);
+        toggled |= ImGui::Checkbox("Render on demand", &onDemand);
+        if (toggled) {
+          ImGui_ImplGlfwGL3_SetCacheDrawData(cacheUi || onDemand);
+        }
+
+        ImGui::Image((GLvoid*)(GLuint)heightmap, ImVec2(100, 100), ImVec2(0,0), ImVec2(1,1), ImColor(255,255,255,255), ImColor(255,255,255,128));
+      ImGui::End();
+
+      ImGui::Begin("Profiler");
+        ImGui::Text("GL state calls: %d issued, %d avoided", glCalls.issued, glCalls.avoided);
+        ImGui::Text("Render queue: %d items, %d program and %d texture set changes",
+                    queue.stats.items, queue.stats.programChanges, queue.stats.textureSetChanges);
+
+        /* Shaded per pixel is the overdraw, near 1 with the pre-pass */
+        ImGui::Checkbox("Depth pre-pass", &depthPrepass);
+        ImGui::Checkbox("Horizon culling", &terrain.horizonCulling);
+        if (terrain.horizonCulling) {
+          ImGui::Text("%d patches below the horizon", terrain.stats.horizonCulled);
+        }
+        ImGui::Checkbox("Occlusion culling", &terrain.occlusionCulling);
+        if (terrain.occlusionCulling) {
+          ImGui::Text("%d patches occluded", terrain.stats.occluded);
+        }
+        GLuint64 shaded = shadedSamples.result();
+        ImGui::Text("Shaded fragments: %llu (%.2f per pixel)", (unsigned long long) shaded, shaded / pixels);
+        if (depthPrepass) {
+          GLuint64 prepass = prepassSamples.result();
+          ImGui::Text("Pre-pass fragments: %llu (%.2f per pixel)", (unsigned long long) prepass, prepass / pixels);
+        }
+      ImGui::End();
+
+      outline.editor();
+    }
+    else {
+      /* One view of the camera path per frame */
+      position = views[capture->frames()].position;
+      target   = views[capture->frames()].target;
+    }
+
+    mat4 projection = reverseZ
+      ? reverse_perspective(radians(60.0f), aspect, 0.01f)
+      : perspective(radians(60.0f), aspect, 0.01f, 100.0f);
     mat4 view = lookAt(position, target, vec3(0.0f, 1.0f, 0.0f));
 
     mat4 model;
@@ -714,36 +1255,161 @@ int main() {
     model *= translate(vec3(-0.5f, -0.5f,  0.0f));
     model *= scale(vec3(1.0f / map_size));
 
-    outline.editor();
+    /* Rendering, the UI leaves scissor testing and blending on */
+    state.disable(GL_SCISSOR_TEST);
+    state.disable(GL_BLEND);
+    state.enable(GL_DEPTH_TEST);
+    state.setDepthMask(true);
+    state.setColorMask(true);
+
+    /* Reverse-Z clears to the far depth 0 and keeps the greater depths */
+    const bool offscreen = reverseZ || capturing;
+    if (offscreen) {
+      scene.bind();
+    }
+    if (reverseZSupported) {
+      state.setClipDepth(reverseZ ? GL_ZERO_TO_ONE : GL_NEGATIVE_ONE_TO_ONE);
+    }
+    const GLenum depthLess      = reverseZ ? GL_GREATER : GL_LESS;
+    const GLenum depthLessEqual = reverseZ ? GL_GEQUAL  : GL_LEQUAL;
 
-    /* Rendering */
     glClearColor(0.322f, 0.275f, 0.337f, 1.0f);
+    glClearDepth(reverseZ ? 0.0 : 1.0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glBindVertexArray(vao);
+    mat4 mvp = projection * view * model;
+    vec3 camera = vec3(inverse(model) * vec4(position, 1.0f));
+    terrain.update(mvp, camera);
 
-    heightmap.bind(0);
+    /* Bindings stay in place between frames, the tracker skips the repeats */
+    /* The pre-pass lays down depth, then only the nearest fragments get shaded */
+    if (depthPrepass) {
+      queue.submit(RenderQueue::DepthPrepass, depth, terrainTextures, 0.0f, [&]() {
+        depthMVP       = mvp;
+        depthCamera    = camera;
+        depthHeightmap = heightmap;
+
+        state.setColorMask(false);
+        state.setDepthFunc(depthLess);
+
+        prepassSamples.begin();
+        terrain.draw();
+        prepassSamples.end();
 
-    glUseProgram(outline);
-      outline["MVP"] = projection * view * model;
-      outline["heightmap"] = heightmap;
+        state.setColorMask(true);
+      });
+    }
 
-      glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, nullptr);
-    glUseProgram(0);
+    queue.submit(RenderQueue::Opaque, outline, terrainTextures, 0.0f, [&]() {
+      outlineMVP         = mvp;
+      outlineCamera      = camera;
+      outlineHeightmap   = heightmap;
+      outlineMaterials   = materials;
+      outlineSplatIndex  = splat.indexUnit();
+      outlineSplatWeight = splat.weightUnit();
 
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glBindVertexArray(0);
+      state.setDepthMask(!depthPrepass);
+      state.setDepthFunc(depthPrepass ? depthLessEqual : depthLess);
+
+      shadedSamples.begin();
+      terrain.draw();
+      shadedSamples.end();
+
+      state.setDepthMask(true);
+    });
 
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-    ImGui::Render();
+    /* Dragged widgets and text cursors keep animating without input */
+    if (!batch && ImGui::IsAnyItemActive()) {
+      request_frames(1);
+    }
+
+    /* Boxes of the patches in the frustum against the finished depth, for the next frames */
+    if (terrain.occlusionCulling) {
+      queue.submit(RenderQueue::Occlusion, box, RenderQueue::NoTextures, 0.0f, [&]() {
+        boxMVP = mvp;
+
+        state.setColorMask(false);
+        state.setDepthMask(false);
+        state.setDepthFunc(depthLessEqual);
+        state.disable(GL_CULL_FACE);
+
+        terrain.testOcclusion([&](const vec3 &lo, const vec3 &hi) {
+          boxMin = lo;
+          boxMax = hi;
+        });
+
+        state.setColorMask(true);
+        state.setDepthMask(true);
+      });
+    }
+
+    /* The UI sets up its own state, over the scene copied to the window */
+    if (!batch) {
+      queue.submit(RenderQueue::Overlay, 0, RenderQueue::NoTextures, 0.0f, [&]() {
+        if (offscreen) {
+          scene.blit(0, framebufferWidth, framebufferHeight);
+        }
+        ImGui::Render();
+      });
+    }
 
-    glfwSwapBuffers(window);
+    queue.execute();
+
+    /* The UI went to the window, the scene alone is captured */
+    if (capturing) {
+      try {
+        capture->capture(scene);
+      }
+      catch (const exception &e) {
+        fprintf(stderr, "Capture failed: %s\n", e.what());
+        captureFailed = true;
+        break;
+      }
+
+      if (capture->frames() >= captureFrames) {
+        glfwSetWindowShouldClose(window, GL_TRUE);
+      }
+    }
+
+    /* The UI changed, draw until it settles */
+    if (!batch && ImGui_ImplGlfwGL3_DrawDataChanged()) {
+      request_frames(1);
+    }
+
+    stream.endFrame();
+
+    /* Batch renders never draw to the window */
+    if (!batch) {
+      glfwSwapBuffers(window);
+    }
+  }
+
+  /* Throughput counts until the last image is on disk */
+  if (capturing && !captureFailed) {
+    try {
+      capture->finish();
+      writer->finish();
+    }
+    catch (const exception &e) {
+      fprintf(stderr, "Capture failed: %s\n", e.what());
+      captureFailed = true;
+    }
+  }
+
+  if (capturing && !captureFailed) {
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - captureStart).count();
+    printf("Captured %d images to '%s' in %.2f s, %.1f images/s\n",
+           capture->frames(), captureDirectory, seconds, capture->frames() / seconds);
   }
 
   /* TODO: Cleanup */
 
-  ImGui_ImplGlfwGL3_Shutdown();
+  if (!batch) {
+    ImGui_ImplGlfwGL3_SetStreamBuffer(nullptr);
+    ImGui_ImplGlfwGL3_Shutdown();
+  }
   glfwTerminate();
 
-  return 0;
+  return captureFailed ? EXIT_FAILURE : 0;
 }
@@ -0,0 +1,237 @@
+/*
+	Offline asset baker
+
+	Converts an image into a DDS file holding the full MIPmap chain,
+	so the runtime can hand it to SOIL_direct_load_DDS without decoding
+	anything.  Color images are compressed to DXT1 (or DXT5 when they
+	have alpha), "-raw" keeps the pixels uncompressed, which is what
+	height maps want (DXT1 endpoints only keep 5 bits of blue).
+
+	The MIPmaps are built by build_mipmap_chain, Kaiser filtered in
+	linear space by default.  "-filter" picks box, kaiser or lanczos,
+	"-linear" filters the stored values as they are (height maps) and
+	"-max" keeps the highest texel instead (height maps that coarser
+	geometry must not sink below).
+
+	The runtime looks for "<image>.dds" next to the image, see Texture.
+
+	usage: asset_baker [-raw] [-filter box|kaiser|lanczos] [-linear] [-max]
+	                   input output.dds
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stb_image_aug.h"
+#include "image_mipmap.h"
+#include "image_DXT.h"
+
+static void fill_header( DDS_header *header,
+		int width, int height, int channels, int levels, int raw )
+{
+	memset( header, 0, sizeof( DDS_header ) );
+	header->dwMagic = ('D' << 0) | ('D' << 8) | ('S' << 16) | (' ' << 24);
+	header->dwSize = 124;
+	header->dwFlags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT;
+	header->dwWidth = width;
+	header->dwHeight = height;
+	header->dwMipMapCount = levels;
+	header->sPixelFormat.dwSize = 32;
+	if( raw )
+	{
+		/*	uncompressed DDS stores BGR(A)	*/
+		header->dwFlags |= DDSD_PITCH;
+		header->dwPitchOrLinearSize = width * channels;
+		header->sPixelFormat.dwFlags = DDPF_RGB;
+		header->sPixelFormat.dwRGBBitCount = 8 * channels;
+		header->sPixelFormat.dwRBitMask = 0x00ff0000;
+		header->sPixelFormat.dwGBitMask = 0x0000ff00;
+		header->sPixelFormat.dwBBitMask = 0x000000ff;
+		if( channels == 4 )
+		{
+			header->sPixelFormat.dwFlags |= DDPF_ALPHAPIXELS;
+			header->sPixelFormat.dwAlphaBitMask = 0xff000000;
+		}
+	} else
+	{
+		header->dwFlags |= DDSD_LINEARSIZE;
+		header->dwPitchOrLinearSize =
+			((width+3) >> 2) * ((height+3) >> 2) * (channels == 4 ? 16 : 8);
+		header->sPixelFormat.dwFlags = DDPF_FOURCC;
+		header->sPixelFormat.dwFourCC =
+			('D' << 0) | ('X' << 8) | ('T' << 16) | ((channels == 4 ? '5' : '1') << 24);
+	}
+	header->sCaps.dwCaps1 = DDSCAPS_TEXTURE;
+	if( levels > 1 )
+	{
+		header->sCaps.dwCaps1 |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+	}
+}
+
+/*	\return 0 if failed, otherwise 1	*/
+static int write_level( FILE *fout, const unsigned char *level,
+		int width, int height, int channels, int raw )
+{
+	unsigned char *data;
+	int size, i, written;
+	if( raw )
+	{
+		/*	swap to BGR(A)	*/
+		size = width * height * channels;
+		data = (unsigned char*)malloc( size );
+		if( NULL == data )
+		{
+			return 0;
+		}
+		for( i = 0; i < size; i += channels )
+		{
+			data[i+0] = level[i+2];
+			data[i+1] = level[i+1];
+			data[i+2] = level[i+0];
+			if( channels == 4 )
+			{
+				data[i+3] = level[i+3];
+			}
+		}
+	} else
+	if( channels == 4 )
+	{
+		data = convert_image_to_DXT5( level, width, height, channels, &size );
+	} else
+	{
+		data = convert_image_to_DXT1( level, width, height, channels, &size );
+	}
+	if( NULL == data )
+	{
+		return 0;
+	}
+	written = (int)fwrite( data, 1, size, fout );
+	free( data );
+	return written == size;
+}
+
+/*	\return 0 if failed, otherwise 1	*/
+static int bake( const char *input, const char *output, int raw,
+		int filter, int flags )
+{
+	FILE *fout;
+	DDS_header header;
+	unsigned char *image, *chain, *level;
+	int width, height, channels, levels, size, i;
+	int ok = 1;
+	image = stbi_load( input, &width, &height, &channels, 4 );
+	if( NULL == image )
+	{
+		fprintf( stderr, "Decoding '%s' failed: %s\n", input, stbi_failure_reason() );
+		return 0;
+	}
+	/*	only keep alpha when the image has some	*/
+	if( (channels == 1) || (channels == 3) )
+	{
+		for( i = 0; i < width * height; ++i )
+		{
+			image[i*3+0] = image[i*4+0];
+			image[i*3+1] = image[i*4+1];
+			image[i*3+2] = image[i*4+2];
+		}
+		channels = 3;
+	} else
+	{
+		channels = 4;
+	}
+	chain = build_mipmap_chain( image, width, height, channels,
+		filter, flags, &levels, &size );
+	stbi_image_free( image );
+	if( NULL == chain )
+	{
+		fprintf( stderr, "Building the MIPmaps of '%s' failed\n", input );
+		return 0;
+	}
+	fout = fopen( output, "wb" );
+	if( NULL == fout )
+	{
+		fprintf( stderr, "Opening '%s' failed\n", output );
+		free( chain );
+		return 0;
+	}
+	fill_header( &header, width, height, channels, levels, raw );
+	ok = (fwrite( &header, sizeof( DDS_header ), 1, fout ) == 1);
+	level = chain;
+	for( i = 0; ok && (i < levels); ++i )
+	{
+		int w = width >> i, h = height >> i;
+		if( w < 1 )
+		{
+			w = 1;
+		}
+		if( h < 1 )
+		{
+			h = 1;
+		}
+		ok = write_level( fout, level, w, h, channels, raw );
+		level += w * h * channels;
+	}
+	free( chain );
+	fclose( fout );
+	if( !ok )
+	{
+		fprintf( stderr, "Baking '%s' failed\n", output );
+		remove( output );
+		return 0;
+	}
+	printf( "Baked '%s' (%dx%d, %d levels, %s)\n", output, width, height, levels,
+		raw ? (channels == 4 ? "BGRA" : "BGR") : (channels == 4 ? "DXT5" : "DXT1") );
+	return 1;
+}
+
+int main( int argc, char **argv )
+{
+	int raw = 0;
+	int filter = MIPMAP_FILTER_KAISER;
+	int flags = MIPMAP_SRGB;
+	int arg = 1;
+	for( ; (arg < argc) && (argv[arg][0] == '-'); ++arg )
+	{
+		if( 0 == strcmp( argv[arg], "-raw" ) )
+		{
+			raw = 1;
+		} else
+		if( 0 == strcmp( argv[arg], "-linear" ) )
+		{
+			flags &= ~MIPMAP_SRGB;
+		} else
+		if( 0 == strcmp( argv[arg], "-max" ) )
+		{
+			flags |= MIPMAP_MAX;
+		} else
+		if( (0 == strcmp( argv[arg], "-filter" )) && (arg + 1 < argc) )
+		{
+			++arg;
+			if( 0 == strcmp( argv[arg], "box" ) )
+			{
+				filter = MIPMAP_FILTER_BOX;
+			} else
+			if( 0 == strcmp( argv[arg], "kaiser" ) )
+			{
+				filter = MIPMAP_FILTER_KAISER;
+			} else
+			if( 0 == strcmp( argv[arg], "lanczos" ) )
+			{
+				filter = MIPMAP_FILTER_LANCZOS;
+			} else
+			{
+				break;
+			}
+		} else
+		{
+			break;
+		}
+	}
+	if( argc - arg != 2 )
+	{
+		fprintf( stderr, "usage: %s [-raw] [-filter box|kaiser|lanczos] [-linear] [-max] input output.dds\n", argv[0] );
+		return 2;
+	}
+	return bake( argv[arg], argv[arg+1], raw, filter, flags ) ? 0 : 1;
+}